@@ -6,19 +6,27 @@
 #include "../inc/quaternion.h"
 #include "../inc/vec3.h"
 #include "../inc/mat3.h"
+#include "../inc/instrumentation.h"
 
-template <typename T>
-class attitude {
+enum class integration_method {euler, rk2, rk4};
+
+template <typename T, typename Instrumentation = No_Instrumentation>
+class attitude : private Instrumentation {
 private:
     Unit_Quaternion<T>  q;
+    integration_method  method;
     Unit_Quaternion<T>  integrate_euler(const Unit_Quaternion<T>& q, const Vec3<T>& w, const T& dt);
     Unit_Quaternion<T>  integrate_rk2(const Unit_Quaternion<T>& q, const Vec3<T>& w, const T& dt);
     Unit_Quaternion<T>  integrate_rk4(const Unit_Quaternion<T>& q, const Vec3<T>& w, const T& dt);
     Quaternion<T>       attitude_kinematics(const Unit_Quaternion<T>& q, const Vec3<T>& w);
 public:
-    attitude() : q{1,0,0,0} {}
-    attitude(const T& w, const T& x, const T& y, const T& z) : q{w,x,y,z} {}
+    attitude() : q{1,0,0,0}, method{integration_method::euler} {}
+    attitude(const T& w, const T& x, const T& y, const T& z) : q{w,x,y,z}, method{integration_method::euler} {}
 
+    void                set_integration_method(integration_method m) {method = m;}
+    integration_method  get_integration_method() const {return method;}
+    const Instrumentation& get_instrumentation() const {return *this;}
+    Instrumentation&    get_instrumentation() {return *this;}
     void                update_attitude(const Vec3<T>& w, const T& dt);
     Vec3<T>             get_attitude_euler();
     Mat3<T>             get_attitude_dcm();
@@ -28,83 +36,103 @@ public:
     void                set_attitude(const Unit_Quaternion<T>& q);
     void                set_attitude(const T& ang, const Vec3<T>& axis);
 };
-template <typename T>
-void attitude<T>::update_attitude(const Vec3<T>& w, const T& dt)
+template <typename T, typename Instrumentation>
+void attitude<T,Instrumentation>::update_attitude(const Vec3<T>& w, const T& dt)
 {
-    q = integrate_euler(q, w, dt);
+    auto stamp = this->begin_update();
+    switch(method) {
+    case integration_method::euler: q = integrate_euler(q, w, dt); break;
+    case integration_method::rk2:   q = integrate_rk2(q, w, dt); break;
+    case integration_method::rk4:   q = integrate_rk4(q, w, dt); break;
+    }
+    this->end_update(stamp);
 }
-template <typename T>
-Quaternion<T> attitude<T>::attitude_kinematics(const Unit_Quaternion<T>& q, const Vec3<T>& w)
+template <typename T, typename Instrumentation>
+Quaternion<T> attitude<T,Instrumentation>::attitude_kinematics(const Unit_Quaternion<T>& q, const Vec3<T>& w)
 {
     Quaternion<T> qw{w};
     return static_cast<T>(1)/2*(q*qw);
 }
-template <typename T>
-Unit_Quaternion<T> attitude<T>::integrate_euler(const Unit_Quaternion<T>& q, const Vec3<T>& w, const T& dt)
+template <typename T, typename Instrumentation>
+Unit_Quaternion<T> attitude<T,Instrumentation>::integrate_euler(const Unit_Quaternion<T>& q, const Vec3<T>& w, const T& dt)
 {
     Quaternion<T> p{q};
     Quaternion<T> dot_q = attitude_kinematics(q, w);
     p += dot_q*dt;
+    this->on_normalize();
     return {p};
 }
-template <typename T>
-Unit_Quaternion<T> attitude<T>::integrate_rk2(const Unit_Quaternion<T>& q, const Vec3<T>& w, const T& dt)
+template <typename T, typename Instrumentation>
+Unit_Quaternion<T> attitude<T,Instrumentation>::integrate_rk2(const Unit_Quaternion<T>& q, const Vec3<T>& w, const T& dt)
 {
     auto f1 = attitude_kinematics(q, w);
     auto k1 = Quaternion<T>{q} + f1*(dt/2);
 
+    this->on_normalize();
     auto f2 = attitude_kinematics({k1}, w);
 
     auto res = Quaternion<T>{q} + f2*dt;
+    this->on_normalize();
     return {res};
 }
-template <typename T>
-Unit_Quaternion<T> attitude<T>::integrate_rk4(const Unit_Quaternion<T>& q, const Vec3<T>& w, const T& dt)
+template <typename T, typename Instrumentation>
+Unit_Quaternion<T> attitude<T,Instrumentation>::integrate_rk4(const Unit_Quaternion<T>& q, const Vec3<T>& w, const T& dt)
 {
     auto f1 = attitude_kinematics(q, w);
     auto k1 = Quaternion<T>{q} + f1*(dt/2);
 
+    this->on_normalize();
     auto f2 = attitude_kinematics({k1}, w);
     auto k2 = Quaternion<T>{q} + f2*(dt/2);
 
+    this->on_normalize();
     auto f3 = attitude_kinematics({k2}, w);
     auto k3 = Quaternion<T>{q} + f3*dt;
 
+    this->on_normalize();
     auto f4 = attitude_kinematics({k3}, w);
 
     auto res = Quaternion<T>{q} + (dt/6)*(f1 + f4) + (dt/3)*(f2 + f3);
+    this->on_normalize();
     return {res};
 }
-template <typename T>
-Vec3<T> attitude<T>::get_attitude_euler()
+template <typename T, typename Instrumentation>
+Vec3<T> attitude<T,Instrumentation>::get_attitude_euler()
 {
-    Vec3<T> E{std::atan2(2*(q[0]*q[1] + q[2]*q[3]), q[0]*q[0] + q[3]*q[3] - q[1]*q[1] - q[2]*q[2]),
-              std::asin(2*(q[0]*q[2] - q[1]*q[3])),
-              std::atan2(2*(q[0]*q[3] + q[1]*q[2]), q[0]*q[0] + q[1]*q[1] - q[2]*q[2] - q[3]*q[3])};
+    using std::atan2;
+    using std::asin;
+    Vec3<T> E{atan2(2*(q[0]*q[1] + q[2]*q[3]), q[0]*q[0] + q[3]*q[3] - q[1]*q[1] - q[2]*q[2]),
+              asin(2*(q[0]*q[2] - q[1]*q[3])),
+              atan2(2*(q[0]*q[3] + q[1]*q[2]), q[0]*q[0] + q[1]*q[1] - q[2]*q[2] - q[3]*q[3])};
     return E;
 }
-template <typename T>
-Unit_Quaternion<T> attitude<T>::get_attitude_quaternion()
+template <typename T, typename Instrumentation>
+Unit_Quaternion<T> attitude<T,Instrumentation>::get_attitude_quaternion()
 {
     return q;
 }
-template <typename T>
-void attitude<T>::set_attitude(const Unit_Quaternion<T>& q)
+template <typename T, typename Instrumentation>
+void attitude<T,Instrumentation>::set_attitude(const Unit_Quaternion<T>& q)
 {
     this->q = q;
 }
-template <typename T>
-void attitude<T>::set_attitude(const T& ang, const Vec3<T>& axis)
+template <typename T, typename Instrumentation>
+void attitude<T,Instrumentation>::set_attitude(const T& ang, const Vec3<T>& axis)
 {
-    Unit_Quaternion<T> p{std::cos(ang/2),axis[0]*std::sin(ang/2),axis[1]*std::sin(ang/2),axis[2]*std::sin(ang/2)};
+    using std::cos;
+    using std::sin;
+    Unit_Quaternion<T> p{cos(ang/2),axis[0]*sin(ang/2),axis[1]*sin(ang/2),axis[2]*sin(ang/2)};
     q = p;
 }
-template <typename T>
-void attitude<T>::set_attitude(const Vec3<T>& E)
+template <typename T, typename Instrumentation>
+void attitude<T,Instrumentation>::set_attitude(const Vec3<T>& E)
 {
-    Unit_Quaternion<T> qx{std::cos(E[0]/2),std::sin(E[0]/2),0,0};
-    Unit_Quaternion<T> qy{std::cos(E[1]/2),0,std::sin(E[1]/2),0};
-    Unit_Quaternion<T> qz{std::cos(E[2]/2),0,0,std::sin(E[2]/2)};
-    q = qz*qy*qx;
+    using std::cos;
+    using std::sin;
+    //q = qz*qy*qx in closed form
+    T cr = cos(E[0]/2), sr = sin(E[0]/2);
+    T cp = cos(E[1]/2), sp = sin(E[1]/2);
+    T cy = cos(E[2]/2), sy = sin(E[2]/2);
+    q = Unit_Quaternion<T>{cr*cp*cy + sr*sp*sy, sr*cp*cy - cr*sp*sy, cr*sp*cy + sr*cp*sy, cr*cp*sy - sr*sp*cy};
 }
 #endif
@@ -0,0 +1,708 @@
+#include <iostream>
+#include <iomanip>
+#include <cmath>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <string>
+#include "../inc/quaternion.h"
+#include "../inc/vec3.h"
+#include "../inc/fixed_point.h"
+#include "../inc/explicit_complementary_filter.h"
+#include "../inc/madgwick.h"
+#include "../inc/euler.h"
+#include "../inc/interpolation.h"
+#include "../inc/quaternion_codec.h"
+#include "../inc/measurement_pipeline.h"
+#include "../inc/calibration.h"
+#include "attitude.h"
+
+/*
+ * Micro benchmarks for the scalar and batch kernels.
+ * Each section prints its cost and the accuracy it trades for it.
+ */
+
+using namespace std;
+using Clock = chrono::steady_clock;
+
+static volatile double sink;
+
+double ns_per(Clock::time_point start, Clock::time_point stop, size_t n)
+{
+    return chrono::duration<double, nano>(stop - start).count()/n;
+}
+template <typename S>
+Vec3<S> convert(const Vec3<float>& v)
+{
+    return {static_cast<S>(v[0]),static_cast<S>(v[1]),static_cast<S>(v[2])};
+}
+template <typename S>
+double angle_between(const Unit_Quaternion<S>& p, const Unit_Quaternion<float>& q)
+{
+    Unit_Quaternion<double> pd{static_cast<double>(p[0]),static_cast<double>(p[1]),static_cast<double>(p[2]),static_cast<double>(p[3])};
+    Unit_Quaternion<double> qd{q[0],q[1],q[2],q[3]};
+    auto d = conjugate(pd)*qd;
+    return 2*atan2(d.imag().magnitude(), abs(d.real()))*180/M_PI;
+}
+
+/*
+ * Fixed point against float
+ */
+template <typename S, typename Op, typename Ref>
+void scalar_row(const string& name, const vector<double>& a, const vector<double>& b, Op op, Ref ref)
+{
+    size_t n = a.size();
+    vector<S> as(n), bs(n);
+    vector<float> af(n), bf(n);
+    for(size_t k = 0; k < n; ++k) {
+        as[k] = static_cast<S>(a[k]); bs[k] = static_cast<S>(b[k]);
+        af[k] = static_cast<float>(a[k]); bf[k] = static_cast<float>(b[k]);
+    }
+    double max_err = 0;
+    for(size_t k = 0; k < n; ++k)
+        max_err = max(max_err, abs(static_cast<double>(op(as[k], bs[k])) - ref(static_cast<double>(as[k]), static_cast<double>(bs[k]))));
+
+    double acc = 0;
+    auto start = Clock::now();
+    for(size_t k = 0; k < n; ++k)
+        acc += static_cast<double>(op(as[k], bs[k]));
+    auto mid = Clock::now();
+    for(size_t k = 0; k < n; ++k)
+        acc += static_cast<double>(op(af[k], bf[k]));
+    auto stop = Clock::now();
+    sink = acc;
+
+    cout << left << setw(10) << name << right << scientific << setprecision(2)
+         << setw(12) << max_err << setw(10) << max_err*(1 << S::frac_bits) << fixed << setprecision(1)
+         << setw(12) << ns_per(start, mid, n) << setw(12) << ns_per(mid, stop, n) << '\n';
+}
+template <typename S>
+void bench_fixed_scalar(const string& title)
+{
+    const size_t n = 200000;
+    mt19937 generator{7};
+    uniform_real_distribution<double> unit(-1, 1);
+    vector<double> a(n), b(n), angle(n), positive(n);
+    for(size_t k = 0; k < n; ++k) {
+        a[k] = unit(generator);
+        b[k] = unit(generator);
+        angle[k] = 10*unit(generator);
+        positive[k] = 50*(unit(generator) + 1);
+    }
+    cout << title << '\n';
+    cout << left << setw(10) << "op" << right << setw(12) << "max err" << setw(10) << "[LSB]"
+         << setw(12) << "fixed ns" << setw(12) << "float ns" << '\n';
+    using std::sqrt; using std::sin; using std::cos; using std::atan2; using std::asin;
+    scalar_row<S>("mul", a, b, [](auto x, auto y) {return x*y;}, [](double x, double y) {return x*y;});
+    scalar_row<S>("div", a, b, [](auto x, auto y) {return x/(abs(y) + decltype(y){1});}, [](double x, double y) {return x/(abs(y) + 1);});
+    scalar_row<S>("sqrt", positive, b, [](auto x, auto) {return sqrt(x);}, [](double x, double) {return sqrt(x);});
+    scalar_row<S>("sin", angle, b, [](auto x, auto) {return sin(x);}, [](double x, double) {return sin(x);});
+    scalar_row<S>("cos", angle, b, [](auto x, auto) {return cos(x);}, [](double x, double) {return cos(x);});
+    scalar_row<S>("atan2", a, b, [](auto x, auto y) {return atan2(x, y);}, [](double x, double y) {return atan2(x, y);});
+    scalar_row<S>("asin", a, b, [](auto x, auto) {return asin(x);}, [](double x, double) {return asin(x);});
+}
+
+struct imu_stream {
+    vector<Vec3<float>> w, u1, u2;
+    vector<Unit_Quaternion<float>> q;
+    float dt;
+};
+imu_stream make_stream(size_t n)
+{
+    imu_stream s;
+    s.dt = 0.01f;
+    mt19937 generator;
+    normal_distribution<float> w_dist(0.0f,0.1f);
+    normal_distribution<float> s1_dist(0.0f,0.2f);
+    normal_distribution<float> s2_dist(0.0f,0.15f);
+    const Vec3<float> w{1,0,0.5f}, b_w{0.1f,0.1f,0.1f}, v1{0,0,1}, v2{1,0,0.2f};
+    attitude<float> att;
+    att.set_integration_method(integration_method::rk4);
+    for(size_t k = 0; k < n; ++k) {
+        att.update_attitude(w, s.dt);
+        auto q = att.get_attitude_quaternion();
+        s.q.push_back(q);
+        s.w.push_back(w + b_w + Vec3<float>{w_dist(generator),w_dist(generator),w_dist(generator)});
+        s.u1.push_back(rotate_vec(conjugate(q),v1) + Vec3<float>{s1_dist(generator),s1_dist(generator),s1_dist(generator)});
+        s.u2.push_back(rotate_vec(conjugate(q),v2) + Vec3<float>{s2_dist(generator),s2_dist(generator),s2_dist(generator)});
+    }
+    return s;
+}
+template <typename Filter, typename S, typename Setup>
+void filter_row(const string& name, const imu_stream& s, Setup setup, vector<Unit_Quaternion<float>>* reference)
+{
+    size_t n = s.w.size();
+    vector<Vec3<S>> w(n), u1(n), u2(n);
+    for(size_t k = 0; k < n; ++k) {
+        w[k] = convert<S>(s.w[k]);
+        u1[k] = convert<S>(s.u1[k]);
+        u2[k] = convert<S>(s.u2[k]);
+    }
+    S dt = static_cast<S>(s.dt);
+    Filter F;
+    setup(F);
+    vector<Unit_Quaternion<S>> q(n);
+    auto start = Clock::now();
+    for(size_t k = 0; k < n; ++k) {
+        F.update_filter(w[k], dt, u1[k], u2[k]);
+        q[k] = F.get_attitude();
+    }
+    auto stop = Clock::now();
+
+    double sum = 0, diff = 0;
+    size_t tail = n - n/4;
+    for(size_t k = tail; k < n; ++k) {
+        double e = angle_between(q[k], s.q[k]);
+        sum += e*e;
+        if(reference && !reference->empty())
+            diff = max(diff, angle_between(q[k], (*reference)[k]));
+    }
+    if(reference && reference->empty()) {
+        for(size_t k = 0; k < n; ++k)
+            reference->push_back({static_cast<float>(q[k][0]),static_cast<float>(q[k][1]),static_cast<float>(q[k][2]),static_cast<float>(q[k][3])});
+    }
+    cout << left << setw(20) << name << right << fixed << setprecision(1) << setw(12) << ns_per(start, stop, n)
+         << setprecision(3) << setw(12) << sqrt(sum/(n - tail)) << setw(14) << diff << '\n';
+}
+template <typename S>
+void ecf_setup(ECF<S,2>& F)
+{
+    F.set_gains(static_cast<S>(2.5f),static_cast<S>(0.2f),static_cast<S>(0.5f),static_cast<S>(0.5f));
+    F.set_reference_vectors(Vec3<S>{0,0,1},convert<S>({1,0,0.2f}));
+}
+template <typename S>
+void madgwick_setup(Madgwick<S>& F)
+{
+    F.set_gains(static_cast<S>(2.0f),static_cast<S>(1.0f),static_cast<S>(0.2f));
+}
+void bench_fixed_point()
+{
+    bench_fixed_scalar<Q16_16>("== Q16.16 scalar ops vs double reference");
+    cout << '\n';
+    bench_fixed_scalar<Q8_24>("== Q8.24 scalar ops vs double reference");
+    cout << '\n';
+
+    imu_stream s = make_stream(20000);
+    cout << "== filters, fixed point vs float (rms over last quarter vs truth, max deviation from float)\n";
+    cout << left << setw(20) << "filter" << right << setw(12) << "ns/update" << setw(12) << "rms[deg]" << setw(14) << "vs float[deg]" << '\n';
+    vector<Unit_Quaternion<float>> ecf_ref, madgwick_ref;
+    filter_row<ECF<float,2>, float>("ecf float", s, ecf_setup<float>, &ecf_ref);
+    filter_row<ECF<Q16_16,2>, Q16_16>("ecf Q16.16", s, ecf_setup<Q16_16>, &ecf_ref);
+    filter_row<ECF<Q8_24,2>, Q8_24>("ecf Q8.24", s, ecf_setup<Q8_24>, &ecf_ref);
+    filter_row<Madgwick<float>, float>("madgwick float", s, madgwick_setup<float>, &madgwick_ref);
+    filter_row<Madgwick<Q16_16>, Q16_16>("madgwick Q16.16", s, madgwick_setup<Q16_16>, &madgwick_ref);
+    filter_row<Madgwick<Q8_24>, Q8_24>("madgwick Q8.24", s, madgwick_setup<Q8_24>, &madgwick_ref);
+}
+
+/*
+ * Batch quaternion <-> Euler conversion against the per-sample attitude path
+ */
+Unit_Quaternion<double> euler_to_quat_exact(double r, double p, double y)
+{
+    double cr = cos(r/2), sr = sin(r/2), cp = cos(p/2), sp = sin(p/2), cy = cos(y/2), sy = sin(y/2);
+    return {cr*cp*cy + sr*sp*sy, sr*cp*cy - cr*sp*sy, cr*sp*cy + sr*cp*sy, cr*cp*sy - sr*sp*cy};
+}
+double rotation_error(const Unit_Quaternion<double>& p, const Unit_Quaternion<float>& q)
+{
+    Unit_Quaternion<double> qd{q[0],q[1],q[2],q[3]};
+    auto d = conjugate(p)*qd;
+    return 2*atan2(d.imag().magnitude(), abs(d.real()));
+}
+void bench_euler()
+{
+    const size_t n = 1 << 20;
+    mt19937 generator{3};
+    normal_distribution<float> normal;
+    uniform_real_distribution<float> angle(-3.14159f, 3.14159f), unit(0, 1);
+    vector<Unit_Quaternion<float>> q(n);
+    for(size_t k = 0; k < n; ++k) {
+        if(k % 32 == 0) {
+            //Exactly gimbal locked samples, and samples 1e-4..2e-3 rad from the lock
+            double delta = k % 64 ? 1e-4*pow(20.0, unit(generator)) : 0;
+            auto p = euler_to_quat_exact(angle(generator), (k % 128 < 64 ? 1 : -1)*(M_PI/2 - delta), angle(generator));
+            q[k] = {static_cast<float>(p[0]),static_cast<float>(p[1]),static_cast<float>(p[2]),static_cast<float>(p[3])};
+        } else {
+            q[k] = {normal(generator),normal(generator),normal(generator),normal(generator)};
+        }
+    }
+    vector<Vec3<float>> E_ref(n), E(n);
+    vector<Unit_Quaternion<float>> q_ref(n), q_out(n);
+
+    attitude<float> att;
+    auto start = Clock::now();
+    for(size_t k = 0; k < n; ++k) {
+        att.set_attitude(q[k]);
+        E_ref[k] = att.get_attitude_euler();
+    }
+    auto mid = Clock::now();
+    quat_to_euler(q.data(), E.data(), n);
+    auto stop = Clock::now();
+    double scalar_ns = ns_per(start, mid, n), batch_ns = ns_per(mid, stop, n);
+
+    vector<float> w(n), x(n), y(n), z(n), roll(n), pitch(n), yaw(n);
+    for(size_t k = 0; k < n; ++k) {
+        w[k] = q[k][0]; x[k] = q[k][1]; y[k] = q[k][2]; z[k] = q[k][3];
+    }
+    start = Clock::now();
+    quat_to_euler(w.data(), x.data(), y.data(), z.data(), roll.data(), pitch.data(), yaw.data(), n);
+    stop = Clock::now();
+    double soa_ns = ns_per(start, stop, n);
+
+    double max_angle = 0, max_rot_ref = 0, max_rot = 0;
+    for(size_t k = 0; k < n; ++k) {
+        double sinp = 2*(static_cast<double>(q[k][0])*q[k][2] - static_cast<double>(q[k][1])*q[k][3]);
+        if(abs(sinp) < 0.999) {
+            for(unsigned int i = 0; i < 3; ++i) {
+                double d = abs(static_cast<double>(E[k][i]) - E_ref[k][i]);
+                max_angle = max(max_angle, min(d, 2*M_PI - d));
+            }
+        }
+        Unit_Quaternion<double> p_ref = euler_to_quat_exact(E_ref[k][0], E_ref[k][1], E_ref[k][2]);
+        Unit_Quaternion<double> p = euler_to_quat_exact(E[k][0], E[k][1], E[k][2]);
+        max_rot_ref = max(max_rot_ref, rotation_error(p_ref, q[k]));
+        max_rot = max(max_rot, rotation_error(p, q[k]));
+    }
+    cout << "== quaternion -> euler, " << n << " samples (1/64 exactly gimbal locked, 1/64 near it)\n";
+    cout << left << setw(24) << "path" << right << setw(12) << "ns/sample" << setw(16) << "max rot err" << '\n';
+    cout << left << setw(24) << "attitude (std::atan2)" << right << fixed << setprecision(2) << setw(12) << scalar_ns
+         << scientific << setw(16) << max_rot_ref << '\n';
+    cout << left << setw(24) << "batch Unit_Quaternion" << right << fixed << setw(12) << batch_ns
+         << scientific << setw(16) << max_rot << '\n';
+    cout << left << setw(24) << "batch SoA" << right << fixed << setw(12) << soa_ns << '\n';
+    cout << "max angle difference to attitude away from gimbal lock: " << scientific << max_angle << " rad\n\n";
+
+    start = Clock::now();
+    for(size_t k = 0; k < n; ++k) {
+        att.set_attitude(E_ref[k]);
+        q_ref[k] = att.get_attitude_quaternion();
+    }
+    mid = Clock::now();
+    euler_to_quat(E_ref.data(), q_out.data(), n);
+    stop = Clock::now();
+    scalar_ns = ns_per(start, mid, n);
+    batch_ns = ns_per(mid, stop, n);
+    start = Clock::now();
+    euler_to_quat(roll.data(), pitch.data(), yaw.data(), w.data(), x.data(), y.data(), z.data(), n);
+    stop = Clock::now();
+    soa_ns = ns_per(start, stop, n);
+
+    max_rot_ref = 0;
+    max_rot = 0;
+    for(size_t k = 0; k < n; ++k) {
+        Unit_Quaternion<double> p = euler_to_quat_exact(E_ref[k][0], E_ref[k][1], E_ref[k][2]);
+        max_rot_ref = max(max_rot_ref, rotation_error(p, q_ref[k]));
+        max_rot = max(max_rot, rotation_error(p, q_out[k]));
+    }
+    cout << "== euler -> quaternion\n";
+    cout << left << setw(24) << "path" << right << setw(12) << "ns/sample" << setw(16) << "max rot err" << '\n';
+    cout << left << setw(24) << "attitude (std::sin)" << right << fixed << setw(12) << scalar_ns
+         << scientific << setw(16) << max_rot_ref << '\n';
+    cout << left << setw(24) << "batch Unit_Quaternion" << right << fixed << setw(12) << batch_ns
+         << scientific << setw(16) << max_rot << '\n';
+    cout << left << setw(24) << "batch SoA" << right << fixed << setw(12) << soa_ns << "\n\n";
+}
+
+/*
+ * Interpolation accuracy and batch resampling against per-sample slerp
+ */
+Unit_Quaternion<double> slerp_exact(const Unit_Quaternion<float>& p, const Unit_Quaternion<float>& q, double t)
+{
+    Unit_Quaternion<double> pd{p[0],p[1],p[2],p[3]};
+    Unit_Quaternion<double> qd{q[0],q[1],q[2],q[3]};
+    auto d = conjugate(pd)*qd;
+    if(d.real() < 0)
+        d = Unit_Quaternion<double>{-d[0],-d[1],-d[2],-d[3]};
+    Vec3<double> axis = d.imag();
+    double n = axis.magnitude();
+    if(n == 0)
+        return pd;
+    return pd*Unit_Quaternion<double>{2*t*atan2(n, d.real()), axis/n};
+}
+//What the per-sample code does today
+Unit_Quaternion<float> slerp_textbook(const Unit_Quaternion<float>& p, const Unit_Quaternion<float>& q, float t)
+{
+    float d = p[0]*q[0] + p[1]*q[1] + p[2]*q[2] + p[3]*q[3];
+    float s = d < 0 ? -1.0f : 1.0f;
+    float theta = acos(min(s*d, 1.0f));
+    float st = sin(theta);
+    if(st < 1e-6f)
+        return p;
+    float a = sin((1 - t)*theta)/st, b = s*sin(t*theta)/st;
+    return {a*p[0] + b*q[0], a*p[1] + b*q[1], a*p[2] + b*q[2], a*p[3] + b*q[3]};
+}
+void bench_interpolation()
+{
+    mt19937 generator{5};
+    normal_distribution<float> normal;
+    uniform_real_distribution<float> unit(0, 1);
+
+    cout << "== nlerp vs exact slerp, max error [rad] per rotation between the endpoints\n";
+    cout << left << setw(14) << "theta <=" << right << setw(14) << "plain nlerp" << setw(14) << "nlerp" << setw(14) << "slerp" << '\n';
+    const double bins[] = {0.1, 0.5, 1.0, M_PI/2, M_PI};
+    double lo = 0;
+    for(double hi : bins) {
+        double e_plain = 0, e_nlerp = 0, e_slerp = 0;
+        for(int k = 0; k < 20000; ++k) {
+            Unit_Quaternion<float> p{normal(generator),normal(generator),normal(generator),normal(generator)};
+            Vec3<float> axis{normal(generator),normal(generator),normal(generator)};
+            axis /= axis.magnitude();
+            float theta = static_cast<float>(lo + (hi - lo)*unit(generator));
+            Unit_Quaternion<float> q = p*Unit_Quaternion<float>{theta, axis};
+            float t = unit(generator);
+            auto ref = slerp_exact(p, q, t);
+            float a = 1 - t;
+            float sign = p[0]*q[0] + p[1]*q[1] + p[2]*q[2] + p[3]*q[3] < 0 ? -1.0f : 1.0f;
+            Unit_Quaternion<float> plain{a*p[0] + sign*t*q[0], a*p[1] + sign*t*q[1], a*p[2] + sign*t*q[2], a*p[3] + sign*t*q[3]};
+            e_plain = max(e_plain, rotation_error(ref, plain));
+            e_nlerp = max(e_nlerp, rotation_error(ref, nlerp(p, q, t)));
+            e_slerp = max(e_slerp, rotation_error(ref, slerp(p, q, t)));
+        }
+        cout << left << setw(14) << setprecision(4) << fixed << hi << right << scientific << setprecision(2)
+             << setw(14) << e_plain << setw(14) << e_nlerp << setw(14) << e_slerp << '\n';
+        lo = hi;
+    }
+
+    //A 100 Hz track resampled onto jittered 30 Hz and dense 1 kHz query streams
+    const size_t n_src = 200000;
+    vector<double> t_src(n_src);
+    vector<Unit_Quaternion<float>> q_src(n_src);
+    attitude<float> att;
+    for(size_t k = 0; k < n_src; ++k) {
+        double t = k*0.01;
+        t_src[k] = t;
+        q_src[k] = att.get_attitude_quaternion();
+        att.update_attitude({static_cast<float>(2*sin(0.3*t)), static_cast<float>(cos(0.7*t)), 0.5f}, 0.01f);
+    }
+    const size_t n_query = 4000000;
+    vector<double> t_query(n_query);
+    for(size_t k = 0; k < n_query; ++k)
+        t_query[k] = t_src.back()*(k + unit(generator))/n_query;
+
+    vector<Unit_Quaternion<float>> q_ref(n_query), q_out(n_query);
+    auto start = Clock::now();
+    size_t j = 0;
+    for(size_t k = 0; k < n_query; ++k) {
+        while(j + 2 < n_src && t_src[j + 1] <= t_query[k])
+            ++j;
+        float u = static_cast<float>((t_query[k] - t_src[j])/(t_src[j + 1] - t_src[j]));
+        q_ref[k] = slerp_textbook(q_src[j], q_src[j + 1], min(max(u, 0.0f), 1.0f));
+    }
+    auto mid = Clock::now();
+    resample(t_src.data(), q_src.data(), n_src, t_query.data(), q_out.data(), n_query);
+    auto stop = Clock::now();
+
+    double e = 0;
+    for(size_t k = 0; k < n_query; k += 7) {
+        Unit_Quaternion<double> r{q_ref[k][0],q_ref[k][1],q_ref[k][2],q_ref[k][3]};
+        e = max(e, rotation_error(r, q_out[k]));
+    }
+    cout << "== resample " << n_src << " samples onto " << n_query << " sorted queries\n";
+    cout << left << setw(24) << "per-sample acos/sin" << right << fixed << setprecision(2) << setw(12) << ns_per(start, mid, n_query) << " ns/query\n";
+    cout << left << setw(24) << "batch resample" << right << setw(12) << ns_per(mid, stop, n_query) << " ns/query\n";
+    cout << "max difference: " << scientific << e << " rad\n\n";
+}
+
+/*
+ * Quaternion codecs
+ */
+template <typename Codec, typename S>
+void codec_row(const string& name, const vector<Unit_Quaternion<S>>& q)
+{
+    const size_t n = q.size();
+    vector<typename Codec::word_type> c(n), c_ref(n);
+    vector<Unit_Quaternion<S>> q_out(n), q_ref(n);
+    auto t0 = Clock::now();
+    for(size_t k = 0; k < n; ++k)
+        c_ref[k] = Codec::encode(q[k]);
+    auto t1 = Clock::now();
+    Codec::encode(q.data(), c.data(), n);
+    auto t2 = Clock::now();
+    for(size_t k = 0; k < n; ++k)
+        q_ref[k] = Codec::template decode<S>(c_ref[k]);
+    auto t3 = Clock::now();
+    Codec::decode(c.data(), q_out.data(), n);
+    auto t4 = Clock::now();
+
+    double e = 0;
+    size_t mismatch = 0;
+    for(size_t k = 0; k < n; ++k) {
+        Unit_Quaternion<double> p{static_cast<double>(q[k][0]),static_cast<double>(q[k][1]),static_cast<double>(q[k][2]),static_cast<double>(q[k][3])};
+        Unit_Quaternion<double> r{static_cast<double>(q_out[k][0]),static_cast<double>(q_out[k][1]),static_cast<double>(q_out[k][2]),static_cast<double>(q_out[k][3])};
+        auto d = conjugate(p)*r;
+        e = max(e, 2*atan2(d.imag().magnitude(), abs(d.real())));
+        mismatch += c[k] != c_ref[k];
+    }
+    cout << left << setw(16) << name << right << setw(6) << Codec::bytes << fixed << setprecision(2)
+         << setw(12) << ns_per(t0, t1, n) << setw(12) << ns_per(t1, t2, n) << setw(12) << ns_per(t2, t3, n) << setw(12) << ns_per(t3, t4, n)
+         << scientific << setw(12) << e << (mismatch ? "  batch/scalar mismatch" : "") << '\n';
+}
+template <typename S>
+void codec_table(const string& title)
+{
+    const size_t n = 1 << 20;
+    mt19937 generator{7};
+    normal_distribution<double> normal;
+    vector<Unit_Quaternion<S>> q(n);
+    for(size_t k = 0; k < n; ++k) {
+        Unit_Quaternion<double> p{normal(generator),normal(generator),normal(generator),normal(generator)};
+        //Every 16th sample is a rotation about a coordinate axis
+        if(k % 16 == 0)
+            p = Unit_Quaternion<double>{normal(generator), Vec3<double>{k % 48 == 0 ? 1.0 : 0.0, k % 48 == 16 ? 1.0 : 0.0, k % 48 == 32 ? 1.0 : 0.0}};
+        q[k] = {static_cast<S>(p[0]),static_cast<S>(p[1]),static_cast<S>(p[2]),static_cast<S>(p[3])};
+    }
+    cout << "== smallest-three codecs, " << title << ", " << n << " random rotations, ns/sample\n";
+    cout << left << setw(16) << "code" << right << setw(6) << "bytes" << setw(12) << "enc scalar" << setw(12) << "enc batch"
+         << setw(12) << "dec scalar" << setw(12) << "dec batch" << setw(12) << "max [rad]" << '\n';
+    codec_row<Quat_Code32>("Quat_Code32", q);
+    codec_row<Quat_Code48>("Quat_Code48", q);
+    codec_row<Quat_Code64>("Quat_Code64", q);
+}
+void bench_codec()
+{
+    codec_table<float>("float");
+    codec_table<double>("double");
+
+    //A 100 Hz attitude track with a fast maneuver in the middle
+    const size_t n = 1 << 20;
+    vector<Unit_Quaternion<float>> q(n);
+    attitude<float> att;
+    for(size_t k = 0; k < n; ++k) {
+        double t = k*0.01;
+        q[k] = att.get_attitude_quaternion();
+        double gain = (k > n/2 && k < n/2 + 500) ? 8 : 0.2;
+        att.update_attitude({static_cast<float>(gain*sin(0.3*t)), static_cast<float>(gain*cos(0.7*t)), static_cast<float>(0.1*gain)}, 0.01f);
+    }
+    cout << "== delta stream, " << n << " samples of a 100 Hz track\n";
+    cout << left << setw(14) << "key interval" << right << setw(14) << "bytes/sample" << setw(10) << "enc ns" << setw(10) << "dec ns"
+         << setw(8) << "keys" << setw(14) << "max key [rad]" << setw(16) << "max delta [rad]" << '\n';
+    for(unsigned interval : {0u, 1000u, 100u}) {
+        Delta_Encoder<float> enc{6, interval};
+        Delta_Decoder<float> dec;
+        vector<uint32_t> words(2*n);
+        vector<Unit_Quaternion<float>> q_out(n);
+        auto t0 = Clock::now();
+        size_t n_words = enc.encode(q.data(), n, words.data());
+        auto t1 = Clock::now();
+        size_t n_out = dec.decode(words.data(), n_words, q_out.data(), q_out.size());
+        auto t2 = Clock::now();
+        double e_key = 0, e_delta = 0;
+        size_t w = 0;
+        for(size_t k = 0; k < n_out; ++k) {
+            Unit_Quaternion<double> p{q[k][0],q[k][1],q[k][2],q[k][3]};
+            bool key = (words[w] & delta_key_flag) != 0;
+            double e = rotation_error(p, q_out[k]);
+            (key ? e_key : e_delta) = max(key ? e_key : e_delta, e);
+            w += key ? 2 : 1;
+        }
+        cout << left << setw(14) << (interval ? to_string(interval) : string{"none"}) << right << fixed << setprecision(3)
+             << setw(14) << 4.0*n_words/n << setprecision(2) << setw(10) << ns_per(t0, t1, n) << setw(10) << ns_per(t1, t2, n)
+             << setw(8) << n_words - n << scientific << setw(14) << e_key << setw(16) << e_delta
+             << (n_out != n ? "  sample count mismatch" : "") << '\n';
+    }
+    cout << '\n';
+}
+
+/*
+ * ECF and Madgwick on one stream, directly and through the shared preprocessing stage
+ */
+struct pipeline_stream {
+    vector<Vec3<float>> w, a, m;
+    vector<Unit_Quaternion<float>> q;
+};
+template <typename Run>
+void pipeline_row(const string& name, const pipeline_stream& s, float dt, Run run)
+{
+    ECF<float,2,Counting_Instrumentation> E;
+    E.set_gains(2.5f,0.2f,0.5f,0.5f);
+    E.set_reference_vectors(Vec3<float>{0,0,1}, Vec3<float>{0.6f,0,-0.8f});
+    Madgwick<float,Counting_Instrumentation> M;
+    M.set_gains(2.0f,1.0f,0.2f);
+    const size_t n = s.w.size();
+    vector<Unit_Quaternion<float>> qe(n);
+    //Best of 5 runs, the filters restart from the same state
+    double ns = 0;
+    for(int r = 0; r < 5; ++r) {
+        E.reset_filter();
+        M.reset_filter();
+        auto start = Clock::now();
+        for(size_t k = 0; k < n; ++k) {
+            run(E, M, s.w[k], dt, s.a[k], s.m[k]);
+            qe[k] = E.get_attitude();
+        }
+        auto stop = Clock::now();
+        ns = r ? min(ns, ns_per(start, stop, n)) : ns_per(start, stop, n);
+    }
+    //Only ECF is scored, Madgwick does not track this motion (see the oscillating rows of attitude_eval)
+    double se = 0;
+    size_t count = 0;
+    for(size_t k = n/4; k < n; ++k) {
+        Unit_Quaternion<double> p{s.q[k][0],s.q[k][1],s.q[k][2],s.q[k][3]};
+        double ee = rotation_error(p, qe[k]);
+        se += ee*ee;
+        ++count;
+    }
+    cout << left << setw(24) << name << right << fixed << setprecision(2) << setw(12) << ns
+         << setw(12) << sqrt(se/count)*180/M_PI
+         << setw(10) << E.get_instrumentation().gated/5 << '\n';
+}
+void bench_pipeline()
+{
+    //100 Hz stream with linear acceleration on 5% and magnetic disturbances on 5% of the samples
+    const size_t n = 200000;
+    const float dt = 0.01f;
+    mt19937 generator{11};
+    normal_distribution<float> noise(0, 0.02f);
+    uniform_real_distribution<float> unit(0, 1);
+    pipeline_stream s;
+    s.w.resize(n); s.a.resize(n); s.m.resize(n); s.q.resize(n);
+    attitude<float> att;
+    const Vec3<float> up{0,0,1}, field{0.6f,0,-0.8f};
+    for(size_t k = 0; k < n; ++k) {
+        double t = k*dt;
+        Vec3<float> w{static_cast<float>(0.5 + 0.5*sin(0.2*t)), static_cast<float>(0.3*sin(0.1*t)), 0};
+        att.update_attitude(w, dt);
+        Unit_Quaternion<float> q = att.get_attitude_quaternion();
+        s.q[k] = q;
+        s.w[k] = w + Vec3<float>{noise(generator),noise(generator),noise(generator)};
+        s.a[k] = rotate_vec(conjugate(q), up) + Vec3<float>{noise(generator),noise(generator),noise(generator)};
+        s.m[k] = rotate_vec(conjugate(q), field) + Vec3<float>{noise(generator),noise(generator),noise(generator)};
+        if(unit(generator) < 0.05f)
+            s.a[k] += Vec3<float>{0.5f*(unit(generator) - 0.5f), 0.5f, 0.3f};
+        if(unit(generator) < 0.05f)
+            s.m[k] += Vec3<float>{0.4f, -0.3f*unit(generator), 0.2f};
+    }
+    cout << "== ECF and Madgwick on one stream, " << n << " samples\n";
+    cout << left << setw(24) << "" << right << setw(12) << "ns/sample" << setw(12) << "ecf [deg]" << setw(10) << "gated" << '\n';
+    pipeline_row("separate", s, dt, [](ECF<float,2,Counting_Instrumentation>& E, Madgwick<float,Counting_Instrumentation>& M,
+                                       const Vec3<float>& w, float dt, const Vec3<float>& a, const Vec3<float>& m) {
+        E.update_filter(w, dt, a, m);
+        M.update_filter(w, dt, a, m);
+    });
+    Measurement_Preprocessor<float> pre;
+    pipeline_row("shared, no gates", s, dt, [&pre](ECF<float,2,Counting_Instrumentation>& E, Madgwick<float,Counting_Instrumentation>& M,
+                                                   const Vec3<float>& w, float dt, const Vec3<float>& a, const Vec3<float>& m) {
+        make_filter_set(E, M).update_filter(pre.process(w, dt, a, m));
+    });
+    Measurement_Preprocessor<float> gated;
+    gated.set_accel_gate(1, 0.1f);
+    gated.set_mag_gate(1, 0.1f);
+    gated.set_inclination_gate(static_cast<float>(asin(0.8)), 0.1f);
+    pipeline_row("shared, gated", s, dt, [&gated](ECF<float,2,Counting_Instrumentation>& E, Madgwick<float,Counting_Instrumentation>& M,
+                                                  const Vec3<float>& w, float dt, const Vec3<float>& a, const Vec3<float>& m) {
+        make_filter_set(E, M).update_filter(gated.process(w, dt, a, m));
+    });
+    cout << '\n';
+}
+
+/*
+ * Streaming magnetometer and gyro calibration: cost per sample and of a solve, and how
+ * well the distortion is recovered
+ */
+template <typename Correct>
+void calibration_row(const string& name, const vector<Vec3<float>>& m, const vector<Vec3<float>>& h, double field, Correct correct)
+{
+    double se = 0, sr = 0;
+    for(size_t k = 0; k < m.size(); ++k) {
+        Vec3<float> u = correct(m[k]);
+        Vec3<float> t = h[k];
+        double cos_e = dot(u, t)/(u.magnitude()*t.magnitude());
+        double e = acos(cos_e > 1 ? 1 : cos_e);
+        double r = u.magnitude()/field - 1;
+        se += e*e;
+        sr += r*r;
+    }
+    cout << left << setw(24) << name << right << fixed << setprecision(3)
+         << setw(12) << sqrt(se/m.size())*180/M_PI << setw(12) << sqrt(sr/m.size()) << '\n';
+}
+void bench_calibration()
+{
+    const size_t n = 20000;
+    const double field = 50;
+    mt19937 generator{13};
+    normal_distribution<float> noise(0, 0.3f);
+    normal_distribution<float> direction(0, 1);
+    const Mat3<float> soft{{1.10f,0.05f,-0.03f},{0.05f,0.95f,0.02f},{-0.03f,0.02f,1.02f}};
+    const Vec3<float> hard{12,-7,20};
+    vector<Vec3<float>> h(n), m(n);
+    for(size_t k = 0; k < n; ++k) {
+        Vec3<float> u{direction(generator),direction(generator),direction(generator)};
+        h[k] = static_cast<float>(field)/u.magnitude()*u;
+        m[k] = soft*h[k] + hard + Vec3<float>{noise(generator),noise(generator),noise(generator)};
+    }
+    Magnetometer_Calibrator<float> mag;
+    double add_ns = 0;
+    for(int r = 0; r < 5; ++r) {
+        mag.reset();
+        auto start = Clock::now();
+        for(size_t k = 0; k < n; ++k)
+            mag.add_sample(m[k]);
+        auto stop = Clock::now();
+        add_ns = r ? min(add_ns, ns_per(start, stop, n)) : ns_per(start, stop, n);
+    }
+    const int solves = 10000;
+    bool ok = true;
+    auto start = Clock::now();
+    for(int r = 0; r < solves; ++r)
+        ok = mag.solve() && ok;
+    auto stop = Clock::now();
+    Vec3<float> offset_error = mag.get_offset() - hard;
+    cout << "== Magnetometer calibration, " << n << " samples, |h| = 50, noise 0.3\n";
+    cout << "add_sample " << fixed << setprecision(2) << add_ns << " ns/sample, solve "
+         << ns_per(start, stop, solves)/1000 << " us" << (ok ? "" : " (failed)")
+         << ", offset error " << setprecision(3) << offset_error.magnitude() << '\n';
+    cout << left << setw(24) << "" << right << setw(12) << "rms [deg]" << setw(12) << "rms |m|" << '\n';
+    calibration_row("raw", m, h, field, [](const Vec3<float>& v) {return v;});
+    Magnetometer_Calibrator<float> sphere;
+    for(size_t k = 0; k < n; ++k)
+        sphere.add_sample(m[k]);
+    sphere.solve_hard_iron();
+    calibration_row("hard iron", m, h, field, [&sphere](const Vec3<float>& v) {return sphere.correct(v);});
+    calibration_row("hard and soft iron", m, h, field, [&mag](const Vec3<float>& v) {return mag.correct(v);});
+    cout << '\n';
+
+    //Gyro regressed on a reference rate, one in ten samples stationary
+    normal_distribution<float> rate_noise(0, 0.005f);
+    uniform_real_distribution<float> unit(0, 1);
+    const Vec3<float> scale{1.02f,0.97f,1.01f}, bias{0.01f,-0.02f,0.005f};
+    vector<Vec3<float>> w(n), w_ref(n);
+    for(size_t k = 0; k < n; ++k) {
+        double t = k*0.01;
+        w_ref[k] = unit(generator) < 0.1f ? Vec3<float>{0,0,0}
+                 : Vec3<float>{static_cast<float>(2*sin(0.7*t)), static_cast<float>(1.5*sin(0.3*t + 1)), static_cast<float>(3*cos(0.5*t))};
+        w[k] = Vec3<float>{scale[0]*w_ref[k][0], scale[1]*w_ref[k][1], scale[2]*w_ref[k][2]} + bias
+             + Vec3<float>{rate_noise(generator),rate_noise(generator),rate_noise(generator)};
+    }
+    Gyro_Calibrator<float> gyro;
+    for(int r = 0; r < 5; ++r) {
+        gyro.reset();
+        start = Clock::now();
+        for(size_t k = 0; k < n; ++k)
+            gyro.add_sample(w[k], w_ref[k]);
+        stop = Clock::now();
+        add_ns = r ? min(add_ns, ns_per(start, stop, n)) : ns_per(start, stop, n);
+    }
+    gyro.solve();
+    double raw = 0, corrected = 0;
+    for(size_t k = 0; k < n; ++k) {
+        Vec3<float> e = w[k] - w_ref[k];
+        raw += dot(e, e);
+        e = gyro.correct(w[k]) - w_ref[k];
+        corrected += dot(e, e);
+    }
+    Vec3<float> scale_error = gyro.get_scale() - scale, bias_error = gyro.get_bias() - bias;
+    cout << "== Gyro calibration, " << n << " samples, noise 0.005 rad/s\n";
+    cout << "add_sample " << fixed << setprecision(2) << add_ns << " ns/sample, scale error "
+         << scientific << setprecision(1) << scale_error.magnitude() << ", bias error " << bias_error.magnitude()
+         << " rad/s\nrms rate error " << sqrt(raw/n) << " raw, " << sqrt(corrected/n) << " corrected [rad/s]\n" << fixed << '\n';
+}
+
+int main()
+{
+    bench_fixed_point();
+    cout << '\n';
+    bench_euler();
+    bench_interpolation();
+    bench_codec();
+    bench_pipeline();
+    bench_calibration();
+}
@@ -0,0 +1,271 @@
+#include <iostream>
+#include <iomanip>
+#include <cmath>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <string>
+#include "../inc/quaternion.h"
+#include "../inc/vec3.h"
+#include "attitude.h"
+#include "../inc/explicit_complementary_filter.h"
+#include "../inc/madgwick.h"
+
+/*
+ * Accuracy versus cost harness.
+ *
+ * Every integrator and filter is run over a set of canned motion profiles at
+ * several sample periods and noise levels. The ground truth is propagated with
+ * the exact exponential map on a 32x finer grid. For each run we report
+ *  - rms / max attitude error [deg] (filters: rms over the last quarter of the run)
+ *  - bias error, |b_est - b_true| at the end of the run [rad/s]
+ *  - convergence time, the time after which the attitude error stays below 5 deg [s]
+ *  - cost of one update [ns], timed over the update loop only
+ * The -adapt rows run the filters with the motion-adaptive schedule of update_schedule.h.
+ * MEKF is not implemented yet (inc/MEKF.h is empty) and is therefore not listed.
+ */
+
+using real = float;
+using Vec3r = Vec3<real>;
+using Quatr = Unit_Quaternion<real>;
+
+struct motion_profile {
+    std::string name;
+    Vec3r (*rate)(double t);
+};
+struct noise_level {
+    std::string name;
+    real gyro;
+    real obs;
+};
+
+static Vec3r rate_static(double)        {return {0,0,0};}
+static Vec3r rate_constant(double)      {return {1,0,0.5f};}
+static Vec3r rate_oscillating(double t)
+{
+    return {static_cast<real>(0.5*std::sin(M_PI*t)), static_cast<real>(0.5*std::cos(M_PI*t)), 0.2f};
+}
+static Vec3r rate_aggressive(double t)
+{
+    return {static_cast<real>(3.0*std::sin(3*M_PI*t)), static_cast<real>(2.0*std::cos(2*M_PI*t)), static_cast<real>(1.5*std::sin(1.4*M_PI*t))};
+}
+//At rest, with a one second maneuver every ten seconds
+static Vec3r rate_bursts(double t)
+{
+    double phase = std::fmod(t, 10.0);
+    if(phase >= 1)
+        return {0,0,0};
+    double s = std::sin(M_PI*phase);
+    return {static_cast<real>(2.0*s), static_cast<real>(-1.0*s), static_cast<real>(1.5*s)};
+}
+
+static const real duration = 60;
+static const real conv_threshold = 5; //deg
+static const int truth_substeps = 32;
+static const Vec3r v1{0,0,1};
+static const Vec3r v2{1,0,0.2f};
+static const Vec3r b_true{0.1f,0.1f,0.1f};
+//Schedule of the -adapt rows: gyro threshold, innovation threshold, max skip, max interval
+static const real sched_gyro = 0.1f;
+static const real sched_innovation = 0.05f;
+static const unsigned int sched_max_skip = 4;
+static const real sched_max_interval = 0.05f;
+
+// Angle of p^-1 q, computed in double and without acos so small errors are not flushed to zero.
+real angle_error(const Quatr& p, const Quatr& q)
+{
+    Unit_Quaternion<double> pd{p[0],p[1],p[2],p[3]};
+    Unit_Quaternion<double> qd{q[0],q[1],q[2],q[3]};
+    auto d = conjugate(pd)*qd;
+    return static_cast<real>(2*std::atan2(d.imag().magnitude(), std::abs(d.real()))*180/M_PI);
+}
+Unit_Quaternion<double> exp_step(Vec3<double> w, double h)
+{
+    double n = w.magnitude();
+    if(n*h < 1e-15)
+        return {};
+    return {n*h, w/n};
+}
+// Truth at the end of every sample, plus the rate the sensors see at the start of it.
+// The truth is propagated in double and renormalized once per sample.
+void generate_truth(const motion_profile& p, real dt, const Quatr& q0, std::vector<Quatr>& q, std::vector<Vec3r>& w)
+{
+    std::size_t n = static_cast<std::size_t>(std::lround(duration/dt));
+    q.resize(n + 1);
+    w.resize(n);
+    q[0] = q0;
+    Unit_Quaternion<double> qk{q0[0],q0[1],q0[2],q0[3]};
+    double h = static_cast<double>(dt)/truth_substeps;
+    for(std::size_t k = 0; k < n; ++k) {
+        double t = k*static_cast<double>(dt);
+        w[k] = p.rate(t);
+        for(int s = 0; s < truth_substeps; ++s) {
+            Vec3r r = p.rate(t + (s + 0.5)*h);
+            qk = qk*exp_step({r[0],r[1],r[2]}, h);
+        }
+        qk = Unit_Quaternion<double>{Quaternion<double>{qk}};
+        q[k + 1] = {static_cast<real>(qk[0]),static_cast<real>(qk[1]),static_cast<real>(qk[2]),static_cast<real>(qk[3])};
+    }
+}
+
+struct result {
+    real rms;
+    real max;
+    real bias;
+    real conv;
+    double ns;
+};
+void print_header()
+{
+    std::cout << std::left << std::setw(8) << "kind" << std::setw(12) << "name" << std::setw(13) << "profile"
+              << std::setw(8) << "dt" << std::setw(7) << "noise" << std::right
+              << std::setw(11) << "rms[deg]" << std::setw(11) << "max[deg]" << std::setw(11) << "bias"
+              << std::setw(9) << "conv[s]" << std::setw(12) << "ns/update" << '\n';
+}
+void print_row(const std::string& kind, const std::string& name, const motion_profile& p, real dt, const std::string& noise, const result& r, bool filter)
+{
+    std::cout << std::left << std::setw(8) << kind << std::setw(12) << name << std::setw(13) << p.name
+              << std::setw(8) << dt << std::setw(7) << noise << std::right << std::fixed
+              << std::setprecision(4) << std::setw(11) << r.rms << std::setw(11) << r.max;
+    if(filter) {
+        std::cout << std::setw(11) << r.bias;
+        if(r.conv < 0)
+            std::cout << std::setw(9) << "-";
+        else
+            std::cout << std::setprecision(2) << std::setw(9) << r.conv;
+    } else {
+        std::cout << std::setw(11) << "-" << std::setw(9) << "-";
+    }
+    std::cout << std::setprecision(1) << std::setw(12) << r.ns << '\n';
+    std::cout.unsetf(std::ios_base::floatfield);
+    std::cout << std::setprecision(6);
+}
+
+result run_integrator(integration_method m, real dt, const std::vector<Quatr>& q_true, const std::vector<Vec3r>& w)
+{
+    attitude<real> att;
+    att.set_integration_method(m);
+    att.set_attitude(q_true[0]);
+    std::vector<Quatr> q_est(w.size());
+
+    auto start = std::chrono::steady_clock::now();
+    for(std::size_t k = 0; k < w.size(); ++k) {
+        att.update_attitude(w[k], dt);
+        q_est[k] = att.get_attitude_quaternion();
+    }
+    auto stop = std::chrono::steady_clock::now();
+
+    result r{0,0,0,-1,0};
+    double sum = 0;
+    for(std::size_t k = 0; k < w.size(); ++k) {
+        real e = angle_error(q_est[k], q_true[k + 1]);
+        sum += e*e;
+        r.max = std::max(r.max, e);
+    }
+    r.rms = static_cast<real>(std::sqrt(sum/w.size()));
+    r.ns = std::chrono::duration<double, std::nano>(stop - start).count()/w.size();
+    return r;
+}
+
+template <typename Filter, typename Setup>
+result run_filter(Setup setup, real dt, const std::vector<Quatr>& q_true, const std::vector<Vec3r>& w,
+                  const noise_level& noise, unsigned int seed)
+{
+    std::mt19937 generator{seed};
+    std::normal_distribution<real> w_dist(0,noise.gyro);
+    std::normal_distribution<real> s_dist(0,noise.obs);
+
+    std::size_t n = w.size();
+    std::vector<Vec3r> w_m(n), u1(n), u2(n);
+    for(std::size_t k = 0; k < n; ++k) {
+        w_m[k] = w[k] + b_true + Vec3r{w_dist(generator),w_dist(generator),w_dist(generator)};
+        u1[k] = rotate_vec(conjugate(q_true[k]),v1) + Vec3r{s_dist(generator),s_dist(generator),s_dist(generator)};
+        u2[k] = rotate_vec(conjugate(q_true[k]),v2) + Vec3r{s_dist(generator),s_dist(generator),s_dist(generator)};
+    }
+
+    Filter F;
+    setup(F);
+    std::vector<Quatr> q_est(n);
+
+    auto start = std::chrono::steady_clock::now();
+    for(std::size_t k = 0; k < n; ++k) {
+        F.update_filter(w_m[k], dt, u1[k], u2[k]);
+        q_est[k] = F.get_attitude();
+    }
+    auto stop = std::chrono::steady_clock::now();
+
+    result r{0,0,0,-1,0};
+    double sum = 0;
+    std::size_t tail = n - n/4;
+    std::size_t last_bad = n;
+    for(std::size_t k = 0; k < n; ++k) {
+        real e = angle_error(q_est[k], q_true[k + 1]);
+        if(e > conv_threshold)
+            last_bad = k;
+        if(k >= tail) {
+            sum += e*e;
+            r.max = std::max(r.max, e);
+        }
+    }
+    r.rms = static_cast<real>(std::sqrt(sum/(n - tail)));
+    r.bias = (F.get_bias() - b_true).magnitude();
+    if(last_bad == n)
+        r.conv = 0;
+    else if(last_bad + 1 < n)
+        r.conv = (last_bad + 1)*dt;
+    r.ns = std::chrono::duration<double, std::nano>(stop - start).count()/n;
+    return r;
+}
+
+int main()
+{
+    const std::vector<motion_profile> profiles{{"static", rate_static},
+                                               {"constant", rate_constant},
+                                               {"oscillating", rate_oscillating},
+                                               {"aggressive", rate_aggressive},
+                                               {"bursts", rate_bursts}};
+    const std::vector<real> dts{0.02f, 0.01f, 0.005f, 0.001f};
+    const std::vector<noise_level> noises{{"low", 0.01f, 0.02f}, {"high", 0.1f, 0.2f}};
+    const Quatr q0{1.0f, Vec3r{0.6f,0.0f,0.8f}};
+
+    print_header();
+    std::vector<Quatr> q_true;
+    std::vector<Vec3r> w;
+    for(const auto& p : profiles) {
+        for(real dt : dts) {
+            generate_truth(p, dt, q0, q_true, w);
+
+            print_row("integr", "euler", p, dt, "-", run_integrator(integration_method::euler, dt, q_true, w), false);
+            print_row("integr", "rk2",   p, dt, "-", run_integrator(integration_method::rk2, dt, q_true, w), false);
+            print_row("integr", "rk4",   p, dt, "-", run_integrator(integration_method::rk4, dt, q_true, w), false);
+
+            unsigned int seed = 1;
+            for(const auto& noise : noises) {
+                auto ecf = run_filter<ECF<real,2>>([](ECF<real,2>& F) {
+                    F.set_gains(2.5f,0.2f,0.5f,0.5f);
+                    F.set_reference_vectors(v1,v2);
+                }, dt, q_true, w, noise, seed);
+                print_row("filter", "ecf", p, dt, noise.name, ecf, true);
+
+                auto madgwick = run_filter<Madgwick<real>>([](Madgwick<real>& F) {
+                    F.set_gains(2.0f,1.0f,0.2f);
+                }, dt, q_true, w, noise, seed);
+                print_row("filter", "madgwick", p, dt, noise.name, madgwick, true);
+
+                auto ecf_adapt = run_filter<ECF<real,2>>([](ECF<real,2>& F) {
+                    F.set_gains(2.5f,0.2f,0.5f,0.5f);
+                    F.set_reference_vectors(v1,v2);
+                    F.set_schedule(sched_gyro, sched_innovation, sched_max_skip, sched_max_interval);
+                }, dt, q_true, w, noise, seed);
+                print_row("filter", "ecf-adapt", p, dt, noise.name, ecf_adapt, true);
+
+                auto madgwick_adapt = run_filter<Madgwick<real>>([](Madgwick<real>& F) {
+                    F.set_gains(2.0f,1.0f,0.2f);
+                    F.set_schedule(sched_gyro, sched_innovation, sched_max_skip, sched_max_interval);
+                }, dt, q_true, w, noise, seed);
+                print_row("filter", "madg-adapt", p, dt, noise.name, madgwick_adapt, true);
+                ++seed;
+            }
+        }
+    }
+}
@@ -72,7 +72,7 @@ int main()
     float dt = 0.01f;
     Vec3f b_w{0.1f,0.1f,0.1f};
 
-    Madgwick<float> M;
+    Madgwick<float, Counting_Instrumentation> M;
     M.set_gains(2.0f,1.0f,0.2f);
     for(float t = 0; t < 100; t += dt){
         att.update_attitude(w,dt);
@@ -93,4 +93,5 @@ int main()
     cout << F.get_bias() << '\n';
     cout << M.get_attitude() << '\n';
     cout << M.get_bias() << '\n';
+    cout << M.get_instrumentation() << '\n';
 }
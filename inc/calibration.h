@@ -0,0 +1,325 @@
+#ifndef CALIBRATION_H
+#define CALIBRATION_H
+#include <cmath>
+#include "vec3.h"
+#include "mat3.h"
+
+/*
+ * Streaming sensor calibration.
+ *
+ * add_sample() folds one measurement into the sufficient statistics of a least squares
+ * fit, at a fixed cost and memory per sample. The fit is solved only on request with
+ * solve(), which may run rarely; until the first successful solve correct() is the
+ * identity. The calibrators are not synchronized: add_sample(), solve() and correct()
+ * must not run concurrently, the caller serializes them (or solves on a copy taken
+ * under its own lock). The corrected vectors go straight into
+ * update_filter() or Measurement_Preprocessor::process().
+ * The statistics are kept in S, double by default, because the fourth order sums of the
+ * magnetometer fit do not fit in float or fixed point. forgetting < 1 weighs old samples
+ * down exponentially, so the estimate follows slow drift; 1 keeps all samples.
+ */
+
+/*
+ * Hard and soft iron calibration of a magnetometer.
+ *
+ * Fits the ellipsoid x'Mx + 2v'x = 1 to the raw samples, 45 + 9 sums of the products of
+ * [x², y², z², 2xy, 2xz, 2yz, 2x, 2y, 2z]. solve() recovers the hard iron offset
+ * c = -M^-1 v and the soft iron correction W, the symmetric square root of the normalized
+ * M, scaled so that corrected vectors keep the geometric mean radius of the ellipsoid.
+ * correct(m) = W(m - c). A rotation of the soft iron distortion is not observable from
+ * magnitudes alone; W assumes it is symmetric.
+ * The samples need to cover the sphere reasonably well. solve() fails and keeps the last
+ * calibration when the fit is singular or not an ellipsoid. solve_hard_iron() fits a
+ * sphere from the same sums, W = I, and needs less coverage.
+ */
+template <typename T, typename S = double>
+class Magnetometer_Calibrator {
+private:
+    //Upper triangle of sum D D^T, row by row
+    S DD[45];
+    S D_sum[9];
+    S n;
+    S forgetting;
+    Vec3<T> c;
+    Mat3<T> W;
+public:
+    Magnetometer_Calibrator(S forgetting = 1) : forgetting{forgetting} {reset();}
+
+    void reset();
+    void add_sample(const Vec3<T>& m);
+    bool solve();
+    bool solve_hard_iron();
+    Vec3<T> correct(const Vec3<T>& m) const {return W*(m - c);}
+
+    Vec3<T> get_offset() const {return c;}
+    Mat3<T> get_soft_iron() const {return W;}
+    //Number of samples, weighted by the forgetting factor
+    S get_weight() const {return n;}
+};
+template <typename T, typename S>
+void Magnetometer_Calibrator<T,S>::reset()
+{
+    for(int k = 0; k < 45; ++k)
+        DD[k] = 0;
+    for(int k = 0; k < 9; ++k)
+        D_sum[k] = 0;
+    n = 0;
+    c = {0,0,0};
+    W = Mat3<T>{{1,0,0},{0,1,0},{0,0,1}};
+}
+template <typename T, typename S>
+void Magnetometer_Calibrator<T,S>::add_sample(const Vec3<T>& m)
+{
+    S x = static_cast<S>(m[0]);
+    S y = static_cast<S>(m[1]);
+    S z = static_cast<S>(m[2]);
+    const S D[9] = {x*x, y*y, z*z, 2*x*y, 2*x*z, 2*y*z, 2*x, 2*y, 2*z};
+    int k = 0;
+    for(int i = 0; i < 9; ++i) {
+        D_sum[i] = forgetting*D_sum[i] + D[i];
+        for(int j = i; j < 9; ++j, ++k)
+            DD[k] = forgetting*DD[k] + D[i]*D[j];
+    }
+    n = forgetting*n + 1;
+}
+
+namespace calibration_detail {
+//Solves A x = b in place by Gaussian elimination with partial pivoting, false if singular
+template <typename S, int N>
+bool solve_linear(S (&A)[N][N], S (&b)[N])
+{
+    using std::abs;
+    S scale = 0;
+    for(int i = 0; i < N; ++i)
+        scale = abs(A[i][i]) > scale ? abs(A[i][i]) : scale;
+    if(!(scale > 0))
+        return false;
+    for(int col = 0; col < N; ++col) {
+        int pivot = col;
+        for(int row = col + 1; row < N; ++row)
+            if(abs(A[row][col]) > abs(A[pivot][col]))
+                pivot = row;
+        if(!(abs(A[pivot][col]) > static_cast<S>(1e-12)*scale))
+            return false;
+        if(pivot != col) {
+            for(int j = 0; j < N; ++j) {
+                S t = A[col][j]; A[col][j] = A[pivot][j]; A[pivot][j] = t;
+            }
+            S t = b[col]; b[col] = b[pivot]; b[pivot] = t;
+        }
+        for(int row = col + 1; row < N; ++row) {
+            S f = A[row][col]/A[col][col];
+            for(int j = col; j < N; ++j)
+                A[row][j] -= f*A[col][j];
+            b[row] -= f*b[col];
+        }
+    }
+    for(int row = N - 1; row >= 0; --row) {
+        for(int j = row + 1; j < N; ++j)
+            b[row] -= A[row][j]*b[j];
+        b[row] /= A[row][row];
+    }
+    return true;
+}
+//Cyclic Jacobi eigendecomposition of a symmetric 3x3 A, A = V diag(d) V'
+template <typename S>
+void symmetric_eigen(S (&A)[3][3], S (&d)[3], S (&V)[3][3])
+{
+    using std::abs;
+    using std::sqrt;
+    for(int i = 0; i < 3; ++i)
+        for(int j = 0; j < 3; ++j)
+            V[i][j] = i == j ? 1 : 0;
+    for(int sweep = 0; sweep < 32; ++sweep) {
+        S off = abs(A[0][1]) + abs(A[0][2]) + abs(A[1][2]);
+        S diag = abs(A[0][0]) + abs(A[1][1]) + abs(A[2][2]);
+        if(!(off > static_cast<S>(1e-15)*diag))
+            break;
+        for(int p = 0; p < 2; ++p) {
+            for(int q = p + 1; q < 3; ++q) {
+                if(A[p][q] == 0)
+                    continue;
+                S theta = (A[q][q] - A[p][p])/(2*A[p][q]);
+                S t = (theta >= 0 ? 1 : -1)/(abs(theta) + sqrt(theta*theta + 1));
+                S cs = 1/sqrt(t*t + 1);
+                S sn = t*cs;
+                for(int k = 0; k < 3; ++k) {
+                    S akp = A[k][p], akq = A[k][q];
+                    A[k][p] = cs*akp - sn*akq;
+                    A[k][q] = sn*akp + cs*akq;
+                }
+                for(int k = 0; k < 3; ++k) {
+                    S apk = A[p][k], aqk = A[q][k];
+                    A[p][k] = cs*apk - sn*aqk;
+                    A[q][k] = sn*apk + cs*aqk;
+                }
+                for(int k = 0; k < 3; ++k) {
+                    S vkp = V[k][p], vkq = V[k][q];
+                    V[k][p] = cs*vkp - sn*vkq;
+                    V[k][q] = sn*vkp + cs*vkq;
+                }
+            }
+        }
+    }
+    for(int i = 0; i < 3; ++i)
+        d[i] = A[i][i];
+}
+}
+
+template <typename T, typename S>
+bool Magnetometer_Calibrator<T,S>::solve()
+{
+    using std::pow;
+    using std::sqrt;
+    S A[9][9];
+    S p[9];
+    int k = 0;
+    for(int i = 0; i < 9; ++i) {
+        p[i] = D_sum[i];
+        for(int j = i; j < 9; ++j, ++k)
+            A[i][j] = A[j][i] = DD[k];
+    }
+    if(!calibration_detail::solve_linear(A, p))
+        return false;
+    S M[3][3] = {{p[0], p[3], p[4]}, {p[3], p[1], p[5]}, {p[4], p[5], p[2]}};
+    S center[3] = {-p[6], -p[7], -p[8]};
+    S M_c[3][3];
+    for(int i = 0; i < 3; ++i)
+        for(int j = 0; j < 3; ++j)
+            M_c[i][j] = M[i][j];
+    if(!calibration_detail::solve_linear(M_c, center))
+        return false;
+    //(x - c)'M(x - c) = 1 + c'Mc
+    S r_sq = 1;
+    for(int i = 0; i < 3; ++i)
+        for(int j = 0; j < 3; ++j)
+            r_sq += center[i]*M[i][j]*center[j];
+    if(!(r_sq > 0))
+        return false;
+    S d[3];
+    S V[3][3];
+    calibration_detail::symmetric_eigen(M, d, V);
+    for(int i = 0; i < 3; ++i) {
+        d[i] /= r_sq;
+        if(!(d[i] > 0))
+            return false;
+    }
+    //Geometric mean radius of the ellipsoid
+    S radius = pow(d[0]*d[1]*d[2], static_cast<S>(-1)/6);
+    for(int i = 0; i < 3; ++i)
+        for(int j = 0; j < 3; ++j) {
+            S w = 0;
+            for(int l = 0; l < 3; ++l)
+                w += V[i][l]*sqrt(d[l])*V[j][l];
+            W(i,j) = static_cast<T>(radius*w);
+        }
+    c = {static_cast<T>(center[0]), static_cast<T>(center[1]), static_cast<T>(center[2])};
+    return true;
+}
+template <typename T, typename S>
+bool Magnetometer_Calibrator<T,S>::solve_hard_iron()
+{
+    //|m|² = 2c'm + r² - |c|², normal equations in [c, r² - |c|²] from the ellipsoid sums
+    //D[i]*D[j] sum, i <= j
+    auto at = [this](int i, int j) {return DD[i*9 - i*(i - 1)/2 + j - i];};
+    S A[4][4] = {{at(6,6), at(6,7), at(6,8), D_sum[6]},
+                 {at(6,7), at(7,7), at(7,8), D_sum[7]},
+                 {at(6,8), at(7,8), at(8,8), D_sum[8]},
+                 {D_sum[6], D_sum[7], D_sum[8], n}};
+    S p[4] = {at(0,6) + at(1,6) + at(2,6), at(0,7) + at(1,7) + at(2,7), at(0,8) + at(1,8) + at(2,8),
+              D_sum[0] + D_sum[1] + D_sum[2]};
+    if(!calibration_detail::solve_linear(A, p))
+        return false;
+    c = {static_cast<T>(p[0]), static_cast<T>(p[1]), static_cast<T>(p[2])};
+    W = Mat3<T>{{1,0,0},{0,1,0},{0,0,1}};
+    return true;
+}
+
+/*
+ * Per axis scale and bias calibration of a gyro, w = s*w_true + b.
+ *
+ * Regresses each measured axis on a reference rate: a turntable, a reference IMU, or the
+ * rate differenced from a trusted attitude. Stationary samples are samples of reference
+ * rate zero and pin the bias down. An axis whose reference rate has not varied enough keeps
+ * its scale and only updates its bias. 4 sums per axis and a shared sample count.
+ * correct(w) = (w - b)/s.
+ */
+template <typename T, typename S = double>
+class Gyro_Calibrator {
+private:
+    S n;
+    S r_sum[3];
+    S w_sum[3];
+    S rr_sum[3];
+    S wr_sum[3];
+    S forgetting;
+    Vec3<T> scale;
+    Vec3<T> bias;
+    Vec3<T> inv_scale;
+public:
+    Gyro_Calibrator(S forgetting = 1) : forgetting{forgetting} {reset();}
+
+    void reset();
+    void add_sample(const Vec3<T>& w, const Vec3<T>& w_ref);
+    void add_stationary(const Vec3<T>& w) {add_sample(w, Vec3<T>{0,0,0});}
+    bool solve();
+    Vec3<T> correct(const Vec3<T>& w) const;
+
+    Vec3<T> get_scale() const {return scale;}
+    Vec3<T> get_bias() const {return bias;}
+    S get_weight() const {return n;}
+};
+template <typename T, typename S>
+void Gyro_Calibrator<T,S>::reset()
+{
+    n = 0;
+    for(int i = 0; i < 3; ++i) {
+        r_sum[i] = 0;
+        w_sum[i] = 0;
+        rr_sum[i] = 0;
+        wr_sum[i] = 0;
+    }
+    scale = {1,1,1};
+    bias = {0,0,0};
+    inv_scale = {1,1,1};
+}
+template <typename T, typename S>
+void Gyro_Calibrator<T,S>::add_sample(const Vec3<T>& w, const Vec3<T>& w_ref)
+{
+    for(int i = 0; i < 3; ++i) {
+        S x = static_cast<S>(w_ref[i]);
+        S y = static_cast<S>(w[i]);
+        r_sum[i] = forgetting*r_sum[i] + x;
+        w_sum[i] = forgetting*w_sum[i] + y;
+        rr_sum[i] = forgetting*rr_sum[i] + x*x;
+        wr_sum[i] = forgetting*wr_sum[i] + x*y;
+    }
+    n = forgetting*n + 1;
+}
+template <typename T, typename S>
+bool Gyro_Calibrator<T,S>::solve()
+{
+    if(!(n > 0))
+        return false;
+    S s[3], b[3];
+    for(int i = 0; i < 3; ++i) {
+        s[i] = static_cast<S>(scale[i]);
+        //n² times the variance of the reference rate
+        S var = n*rr_sum[i] - r_sum[i]*r_sum[i];
+        if(var > static_cast<S>(1e-6)*n*rr_sum[i])
+            s[i] = (n*wr_sum[i] - w_sum[i]*r_sum[i])/var;
+        if(!(s[i] > 0))
+            return false;
+        b[i] = (w_sum[i] - s[i]*r_sum[i])/n;
+    }
+    scale = {static_cast<T>(s[0]), static_cast<T>(s[1]), static_cast<T>(s[2])};
+    bias = {static_cast<T>(b[0]), static_cast<T>(b[1]), static_cast<T>(b[2])};
+    inv_scale = {static_cast<T>(1/s[0]), static_cast<T>(1/s[1]), static_cast<T>(1/s[2])};
+    return true;
+}
+template <typename T, typename S>
+Vec3<T> Gyro_Calibrator<T,S>::correct(const Vec3<T>& w) const
+{
+    return {(w[0] - bias[0])*inv_scale[0], (w[1] - bias[1])*inv_scale[1], (w[2] - bias[2])*inv_scale[2]};
+}
+#endif // CALIBRATION_H
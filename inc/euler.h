@@ -0,0 +1,117 @@
+#ifndef EULER_H
+#define EULER_H
+#include <cstddef>
+#include <cmath>
+#include <algorithm>
+#include <limits>
+#include "quaternion.h"
+#include "vec3.h"
+#include "fast_math.h"
+
+/*
+ * Batch conversion between unit quaternions and roll/pitch/yaw (ZYX, q = qz*qy*qx),
+ * the same convention as attitude::get_attitude_euler and attitude::set_attitude.
+ *
+ * The kernels work on structure-of-arrays input, are branch free and vectorize;
+ * the arrays must not overlap.
+ * The Unit_Quaternion/Vec3 overloads gather blocks of batch_block samples into
+ * such arrays first.
+ *
+ * quat_to_euler splits the rotation with the half angle sums
+ *  (x - z, w + y) = (cos(p/2) + sin(p/2))*(sin, cos)((roll - yaw)/2)
+ *  (x + z, w - y) = (cos(p/2) - sin(p/2))*(sin, cos)((roll + yaw)/2)
+ * and pitch = atan2(|a|^2 - |b|^2, 2|a||b|) of the two pairs a and b. Near gimbal lock one
+ * pair vanishes together with the influence of its angle on the rotation, so the result
+ * reproduces the input rotation to within 4.3e-6 rad in float and 3.8e-6 rad in double at
+ * any pitch, with fast_atan2. Away from the lock, |sin(pitch)| < 0.999, each angle is
+ * within 4.7e-6 rad (float) and 3.4e-6 rad (double) of the exact one.
+ * When the residual tilt from +-pi/2 is below 2*euler_gimbal_margin<T>() the split is
+ * rounding noise: roll is set to 0 and yaw carries the whole rotation about the
+ * vertical, which adds at most 4*euler_gimbal_margin<T>() to the error.
+ * euler_to_quat is the closed form product qz*qy*qx with fast_sincos, accurate to
+ * 2e-7 per component in float, so its output is stored without renormalization.
+ */
+//tan of half the residual tilt below which roll and yaw are not separated
+template <typename T>
+inline T euler_gimbal_margin()
+{
+    return 4*std::numeric_limits<T>::epsilon();
+}
+//a in [-2*pi, 2*pi] to [-pi, pi]
+template <typename T>
+inline T wrap_pi(T a)
+{
+    const T pi = static_cast<T>(fast_math_constants::pi);
+    return a > pi ? a - 2*pi : (a < -pi ? a + 2*pi : a);
+}
+
+template <typename T>
+void quat_to_euler(const T* ATT_RESTRICT qw, const T* ATT_RESTRICT qx, const T* ATT_RESTRICT qy, const T* ATT_RESTRICT qz,
+                   T* ATT_RESTRICT roll, T* ATT_RESTRICT pitch, T* ATT_RESTRICT yaw, std::size_t n)
+{
+    using std::sqrt;
+    const T m2 = euler_gimbal_margin<T>()*euler_gimbal_margin<T>();
+    for(std::size_t k = 0; k < n; ++k) {
+        T w = qw[k], x = qx[k], y = qy[k], z = qz[k];
+        T dx = x - z, dw = w + y;
+        T sx = x + z, sw = w - y;
+        T a2 = dx*dx + dw*dw;
+        T b2 = sx*sx + sw*sw;
+        T p = fast_atan2(a2 - b2, 2*sqrt(a2*b2));
+        //(roll - yaw)/2 and (roll + yaw)/2, each defined up to pi by the sign of q
+        T d = fast_atan2(dx, dw);
+        T s = fast_atan2(sx, sw);
+        //Gimbal lock: only yaw - roll (pitch up) or yaw + roll (pitch down) is defined
+        bool up = b2 <= m2*a2;
+        bool down = a2 <= m2*b2;
+        roll[k] = up || down ? static_cast<T>(0) : wrap_pi(s + d);
+        pitch[k] = p;
+        yaw[k] = wrap_pi(up ? -2*d : (down ? 2*s : s - d));
+    }
+}
+template <typename T>
+void euler_to_quat(const T* ATT_RESTRICT roll, const T* ATT_RESTRICT pitch, const T* ATT_RESTRICT yaw,
+                   T* ATT_RESTRICT qw, T* ATT_RESTRICT qx, T* ATT_RESTRICT qy, T* ATT_RESTRICT qz, std::size_t n)
+{
+    for(std::size_t k = 0; k < n; ++k) {
+        T sr, cr, sp, cp, sy, cy;
+        fast_sincos(roll[k]/2, sr, cr);
+        fast_sincos(pitch[k]/2, sp, cp);
+        fast_sincos(yaw[k]/2, sy, cy);
+        qw[k] = cr*cp*cy + sr*sp*sy;
+        qx[k] = sr*cp*cy - cr*sp*sy;
+        qy[k] = cr*sp*cy + sr*cp*sy;
+        qz[k] = cr*cp*sy - sr*sp*cy;
+    }
+}
+template <typename T>
+void quat_to_euler(const Unit_Quaternion<T>* q, Vec3<T>* E, std::size_t n)
+{
+    T w[batch_block], x[batch_block], y[batch_block], z[batch_block];
+    T roll[batch_block], pitch[batch_block], yaw[batch_block];
+    for(std::size_t i = 0; i < n; i += batch_block) {
+        std::size_t m = std::min(batch_block, n - i);
+        for(std::size_t k = 0; k < m; ++k) {
+            w[k] = q[i + k][0]; x[k] = q[i + k][1]; y[k] = q[i + k][2]; z[k] = q[i + k][3];
+        }
+        quat_to_euler(w, x, y, z, roll, pitch, yaw, m);
+        for(std::size_t k = 0; k < m; ++k)
+            E[i + k] = {roll[k], pitch[k], yaw[k]};
+    }
+}
+template <typename T>
+void euler_to_quat(const Vec3<T>* E, Unit_Quaternion<T>* q, std::size_t n)
+{
+    T w[batch_block], x[batch_block], y[batch_block], z[batch_block];
+    T roll[batch_block], pitch[batch_block], yaw[batch_block];
+    for(std::size_t i = 0; i < n; i += batch_block) {
+        std::size_t m = std::min(batch_block, n - i);
+        for(std::size_t k = 0; k < m; ++k) {
+            roll[k] = E[i + k][0]; pitch[k] = E[i + k][1]; yaw[k] = E[i + k][2];
+        }
+        euler_to_quat(roll, pitch, yaw, w, x, y, z, m);
+        for(std::size_t k = 0; k < m; ++k)
+            assign_unit(q[i + k], w[k], x[k], y[k], z[k]);
+    }
+}
+#endif // EULER_H
@@ -5,6 +5,9 @@
 #include "quaternion.h"
 #include "vec3.h"
 #include "mat3.h"
+#include "instrumentation.h"
+#include "update_schedule.h"
+#include "measurement_pipeline.h"
 /*
  * Constructor
  * Reset filter
@@ -12,8 +15,8 @@
  * get state
  */
 
-template <typename T, int N>
-class ECF {
+template <typename T, int N, typename Instrumentation = No_Instrumentation>
+class ECF : private Instrumentation {
 private:
     Unit_Quaternion<T> q;
     Vec3<T> b;
@@ -23,27 +26,35 @@ private:
     T ki;
     T kp;
     unsigned int i;
+    Update_Schedule<T> schedule;
+    std::vector<Vec3<T>> U_sum;
 public:
-    ECF() : q{1,0,0,0}, b{0,0,0}, V(N,{0,0,0}), U(N,{0,0,0}), K{N,0}, ki{0}, kp{0}, i{0} {}
+    ECF() : q{1,0,0,0}, b{0,0,0}, V(N,{0,0,0}), U(N,{0,0,0}), K{N,0}, ki{0}, kp{0}, i{0}, U_sum(N,{0,0,0}) {}
     //template <typename... Tail>
     //ECF(Vec3<T> v, Tail... tail);
     Unit_Quaternion<T> get_attitude() {return q;}
     Vec3<T> get_bias() {return b;}
+    const Instrumentation& get_instrumentation() const {return *this;}
+    Instrumentation& get_instrumentation() {return *this;}
 
-    ECF(ECF<T,N>& f) = delete;
-    ECF<T,N>& operator=(ECF<T,N>& f) = delete;
-    ECF(ECF<T,N>&& f) = delete;
-    ECF<T,N>& operator=(ECF<T,N>&& f) = delete;
+    ECF(ECF<T,N,Instrumentation>& f) = delete;
+    ECF<T,N,Instrumentation>& operator=(ECF<T,N,Instrumentation>& f) = delete;
+    ECF(ECF<T,N,Instrumentation>&& f) = delete;
+    ECF<T,N,Instrumentation>& operator=(ECF<T,N,Instrumentation>&& f) = delete;
 
     template <typename... Tail>
     void set_gains(T kp, T ki, Tail... tail);
-    void reset_filter() {q = {1,0,0,0}; b = {0,0,0};}
+    //See update_schedule.h, disabled by default
+    void set_schedule(T gyro_threshold, T innovation_threshold, unsigned int max_skip, T max_interval);
+    void reset_filter();
     template <typename... Tail>
     void set_reference_vectors(Vec3<T> v, Tail... tail);
     template <typename... Tail>
     void set_reference_vectors() {i = 0;}
     template <typename... Tail>
     void update_filter(Vec3<T> w, T dt, Tail... tail);
+    //a and m observe the first and second reference vector, see measurement_pipeline.h
+    void update_filter(const Preprocessed_Sample<T>& s);
 private:
     template <typename... Tail>
     void set_Ks(T k, Tail... tail);
@@ -52,75 +63,168 @@ private:
     void set_observation_vectors(Vec3<T> v, Tail... tail);
     template <typename... Tail>
     void set_observation_vectors() {i = 0;}
+    void filter_step(const Vec3<T>& w, const T& dt, unsigned int valid);
+    Vec3<T> innovation(unsigned int valid);
     void update_attitude(const Vec3<T>& w, const T& dt);
     Quaternion<T> attitude_kinematics(const Unit_Quaternion<T>& q, const Vec3<T>& w);
     Unit_Quaternion<T> integrate_euler(const Unit_Quaternion<T>& q, const Vec3<T>& w, const T& dt);
 };
-template <typename T, int N>
+template <typename T, int N, typename Instrumentation>
 template <typename... Tail>
-void ECF<T,N>::set_gains(T kp, T ki, Tail... tail)
+void ECF<T,N,Instrumentation>::set_gains(T kp, T ki, Tail... tail)
 {
     this->ki = ki;
     this->kp = kp;
     i = 0;
     set_Ks(tail...);
 }
-template<typename T, int N>
+template<typename T, int N, typename Instrumentation>
 template <typename... Tail>
-void ECF<T,N>::set_Ks(T k, Tail... tail)
+void ECF<T,N,Instrumentation>::set_Ks(T k, Tail... tail)
 {
     assert(i<N);
     K[i++] = k;
     set_Ks(tail...);
 }
-template <typename T, int N>
+template <typename T, int N, typename Instrumentation>
+void ECF<T,N,Instrumentation>::set_schedule(T gyro_threshold, T innovation_threshold, unsigned int max_skip, T max_interval)
+{
+    schedule.configure(gyro_threshold, innovation_threshold, max_skip, max_interval);
+    for(int n = 0; n < N; ++n)
+        U_sum[n] = {0,0,0};
+}
+template <typename T, int N, typename Instrumentation>
+void ECF<T,N,Instrumentation>::reset_filter()
+{
+    q = {1,0,0,0};
+    b = {0,0,0};
+    schedule.reset();
+    for(int n = 0; n < N; ++n)
+        U_sum[n] = {0,0,0};
+}
+template <typename T, int N, typename Instrumentation>
 template <typename... Tail>
-void ECF<T,N>::set_reference_vectors(Vec3<T> v, Tail... tail)
+void ECF<T,N,Instrumentation>::set_reference_vectors(Vec3<T> v, Tail... tail)
 {
     assert(i < N);
     V[i++] = v;
     set_reference_vectors(tail...);
 }
-template <typename T, int N>
+template <typename T, int N, typename Instrumentation>
 template <typename... Tail>
-void ECF<T,N>::set_observation_vectors(Vec3<T> u, Tail... tail)
+void ECF<T,N,Instrumentation>::set_observation_vectors(Vec3<T> u, Tail... tail)
 {
     assert(i < N);
     U[i++] = u;
     set_observation_vectors(tail...);
 }
-template <typename T, int N>
+template <typename T, int N, typename Instrumentation>
 template <typename... Tail>
-void ECF<T,N>::update_filter(Vec3<T> w, T dt, Tail... tail)
+void ECF<T,N,Instrumentation>::update_filter(Vec3<T> w, T dt, Tail... tail)
 {
+    auto stamp = this->begin_update();
     i = 0;
     set_observation_vectors(tail...);
+    filter_step(w, dt, (1u << N) - 1);
+    this->end_update(stamp);
+}
+template <typename T, int N, typename Instrumentation>
+void ECF<T,N,Instrumentation>::update_filter(const Preprocessed_Sample<T>& s)
+{
+    static_assert(N == 2, "A preprocessed sample observes two reference vectors");
+    auto stamp = this->begin_update();
+    //Raw vectors as in the direct path, the gains act on |U[n]||V[n]| alike
+    U[0] = s.a;
+    U[1] = s.m;
+    //The common case spelled out, so that it compiles to the direct path
+    if(s.a_valid && s.m_valid)
+        filter_step(s.w, s.dt, 3u);
+    else
+        filter_step(s.w, s.dt, (s.a_valid ? 1u : 0u) | (s.m_valid ? 2u : 0u));
+    this->end_update(stamp);
+}
+//Correction from the observations U[n] whose bit n is set in valid
+template <typename T, int N, typename Instrumentation>
+void ECF<T,N,Instrumentation>::filter_step(const Vec3<T>& w, const T& dt, unsigned int valid)
+{
+    const unsigned int all = (1u << N) - 1;
+    if(valid != all)
+        this->on_gated_sample();
+    if(!schedule.enabled()) {
+        Vec3<T> mes = innovation(valid);
+        update_attitude(w - b + kp*mes, dt);
+        Vec3<T> dot_b = -ki*mes;
+        b += dt*dot_b;
+        return;
+    }
+    if(valid == 0) {
+        //Gyro only, rotate the sums of skipped observations into the new body frame
+        schedule.gated(dt);
+        if(schedule.skipped_in_row())
+            for(int n = 0; n < N; ++n)
+                accumulate_observation(U_sum[n], w - b, dt, Vec3<T>{0,0,0});
+        update_attitude(w - b, dt);
+        return;
+    }
+    if(schedule.skip(w - b, dt, valid == all)) {
+        this->on_skipped_correction();
+        for(int n = 0; n < N; ++n)
+            accumulate_observation(U_sum[n], w - b, dt, U[n]);
+        update_attitude(w - b, dt);
+        return;
+    }
+    //Time the correction covers, dt unless corrections were skipped
+    T dt_c = schedule.correction_dt();
+    if(schedule.skipped_in_row()) {
+        //A rejected observation falls back to its average over the skipped samples
+        for(int n = 0; n < N; ++n) {
+            bool used = (valid >> n) & 1;
+            accumulate_observation(U_sum[n], w - b, dt, used ? U[n] : Vec3<T>{0,0,0});
+            U[n] = U_sum[n]/(used ? dt_c : dt_c - dt);
+            U_sum[n] = {0,0,0};
+        }
+        valid = all;
+    }
+    Vec3<T> mes = innovation(valid);
+    //|mes| of an attitude error e is at most e times this stiffness, report e in rad
+    T stiffness = 0;
+    for(int n = 0; n < N; ++n)
+        stiffness += K[n]*dot(V[n],V[n]);
+    schedule.corrected(dot(mes,mes)/(stiffness*stiffness));
+    update_attitude(w - b + dt_c/dt*(kp*mes), dt);
+    Vec3<T> dot_b = -ki*mes;
+    b += dt_c*dot_b;
+}
+template <typename T, int N, typename Instrumentation>
+Vec3<T> ECF<T,N,Instrumentation>::innovation(unsigned int valid)
+{
     Vec3<T> mes{0,0,0};
     for(int n = 0; n < N;++n){
-        mes += K[n]*cross(U[n], rotate_vec(conjugate(q),V[n]));
+        if((valid >> n) & 1)
+            mes += K[n]*cross(U[n], rotate_vec(conjugate(q),V[n]));
         //mes += K[n]*cross(rotate_vec(q,U[n]), V[n]);
     }
-    update_attitude(w - b + kp*mes, dt);
-    Vec3<T> dot_b = -ki*mes;
-    b += dt*dot_b;
+    this->on_innovation(mes);
+    return mes;
 }
-template <typename T, int N>
-void ECF<T,N>::update_attitude(const Vec3<T>& w, const T& dt)
+template <typename T, int N, typename Instrumentation>
+void ECF<T,N,Instrumentation>::update_attitude(const Vec3<T>& w, const T& dt)
 {
     q = integrate_euler(q, w, dt);
 }
-template <typename T, int N>
-Quaternion<T> ECF<T,N>::attitude_kinematics(const Unit_Quaternion<T>& q, const Vec3<T>& w)
+template <typename T, int N, typename Instrumentation>
+Quaternion<T> ECF<T,N,Instrumentation>::attitude_kinematics(const Unit_Quaternion<T>& q, const Vec3<T>& w)
 {
     Quaternion<T> qw{w};
     return static_cast<T>(1)/2*(q*qw);
 }
-template <typename T, int N>
-Unit_Quaternion<T> ECF<T,N>::integrate_euler(const Unit_Quaternion<T>& q, const Vec3<T>& w, const T& dt)
+template <typename T, int N, typename Instrumentation>
+Unit_Quaternion<T> ECF<T,N,Instrumentation>::integrate_euler(const Unit_Quaternion<T>& q, const Vec3<T>& w, const T& dt)
 {
     Quaternion<T> p{q};
     Quaternion<T> dot_q = attitude_kinematics(q, w);
     p += dot_q*dt;
+    this->on_normalize();
     return {p};
 }
 #endif // EXPLICIT_COMPLEMENTARY_FILTER_H
@@ -0,0 +1,91 @@
+#ifndef FAST_MATH_H
+#define FAST_MATH_H
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+
+/*
+ * Polynomial approximations of the trigonometric functions used by the batch kernels.
+ *
+ * All functions are branch free (selects only, no calls into libm) so that loops
+ * over arrays of them are vectorized by the compiler. Maximum absolute errors,
+ * measured against double precision over the whole domain:
+ *  fast_atan2      1.7e-6 rad (polynomial), plus rounding: 2.4e-6 rad in float
+ *  fast_asin       as fast_atan2, the argument is clamped to [-1, 1]
+ *  fast_sincos     6e-8 (polynomial) for |a| <= 2*pi, plus rounding: 1.7e-7 in float.
+ *                  Range reduction is done in T, so the error grows with |a|: in float
+ *                  2.5e-7 up to |a| = 1e4 and 2.4e-6 up to 2e5 = 2^16*pi, where k*pi_hi
+ *                  stops being exact; in double 1e-7 up to 1e9. Larger |a|, up to the
+ *                  2^30*pi of the clamp and beyond, give a defined but meaningless result,
+ *                  not even within [-1, 1]; NaN stays NaN.
+ * GCC needs -fno-math-errno -fno-trapping-math to vectorize the selects and sqrt,
+ * see CMakeLists.txt.
+ */
+//The batch kernels promise the compiler that their array arguments do not overlap
+#if defined(__GNUC__) || defined(_MSC_VER)
+#define ATT_RESTRICT __restrict
+#else
+#define ATT_RESTRICT
+#endif
+
+//Number of samples the array-of-structures wrappers gather into local arrays at a time
+const std::size_t batch_block = 64;
+
+namespace fast_math_constants {
+const double pi      = 3.14159265358979323846;
+const double pi_2    = 1.57079632679489661923;
+const double inv_pi  = 0.31830988618379067154;
+//pi split in a head that is exact in float and a tail, for the range reduction
+const double pi_hi   = 3.140625;
+const double pi_lo   = 9.67653589793e-4;
+}
+
+template <typename T>
+inline T fast_atan2(T y, T x)
+{
+    using std::abs;
+    using namespace fast_math_constants;
+    T ax = abs(x);
+    T ay = abs(y);
+    T mx = std::max(ax, ay);
+    T mn = std::min(ax, ay);
+    T a = mn/(mx > 0 ? mx : static_cast<T>(1));
+    T s = a*a;
+    //Odd minimax polynomial for atan on [0, 1]
+    T r = a*(static_cast<T>(0.99997726) + s*(static_cast<T>(-0.33262347) + s*(static_cast<T>(0.19354346)
+          + s*(static_cast<T>(-0.11643287) + s*(static_cast<T>(0.05265332) + s*static_cast<T>(-0.01172120))))));
+    r = ay > ax ? static_cast<T>(pi_2) - r : r;
+    r = x < 0 ? static_cast<T>(pi) - r : r;
+    return y < 0 ? -r : r;
+}
+template <typename T>
+inline T fast_asin(T a)
+{
+    using std::sqrt;
+    T x = std::min(std::max(a, static_cast<T>(-1)), static_cast<T>(1));
+    return fast_atan2(x, sqrt((1 - x)*(1 + x)));
+}
+template <typename T>
+inline void fast_sincos(T a, T& s, T& c)
+{
+    using namespace fast_math_constants;
+    //a = k*pi + r with |r| <= pi/2, sin(a) = (-1)^k sin(r), cos(a) = (-1)^k cos(r)
+    T t = a*static_cast<T>(inv_pi);
+    //Clamped so that the conversion is defined, NaN maps to the lower bound
+    const T t_max = static_cast<T>(1 << 30);
+    t = std::min(std::max(-t_max, t), t_max);
+    std::int32_t k = static_cast<std::int32_t>(t + (t < 0 ? static_cast<T>(-0.5) : static_cast<T>(0.5)));
+    T kf = static_cast<T>(k);
+    T r = (a - kf*static_cast<T>(pi_hi)) - kf*static_cast<T>(pi_lo);
+    T sign = static_cast<T>(1 - 2*(k & 1));
+    T r2 = r*r;
+    //Taylor polynomials, truncation error below 6e-8 on [-pi/2, pi/2]
+    T sr = r + r*r2*(static_cast<T>(-1.0/6) + r2*(static_cast<T>(1.0/120) + r2*(static_cast<T>(-1.0/5040)
+           + r2*(static_cast<T>(1.0/362880) + r2*static_cast<T>(-1.0/39916800)))));
+    T cr = 1 + r2*(static_cast<T>(-0.5) + r2*(static_cast<T>(1.0/24) + r2*(static_cast<T>(-1.0/720)
+           + r2*(static_cast<T>(1.0/40320) + r2*(static_cast<T>(-1.0/3628800) + r2*static_cast<T>(1.0/479001600))))));
+    s = sign*sr;
+    c = sign*cr;
+}
+#endif // FAST_MATH_H
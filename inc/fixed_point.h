@@ -0,0 +1,223 @@
+#ifndef FIXED_POINT_H
+#define FIXED_POINT_H
+#include <iostream>
+#include <cstdint>
+#include <cmath>
+
+/*
+ * Q-format fixed-point scalar for cores without an FPU.
+ *
+ * Fixed<F> stores a value as a saturating 32 bit integer with F fractional bits,
+ * i.e. Q(31-F).F. Every operation saturates at the representable range instead of
+ * wrapping, division by zero saturates towards the sign of the dividend.
+ * The math functions used by the library (sqrt, sin, cos, atan2, asin, abs) are
+ * provided as friends and found by argument dependent lookup, so library code calls
+ * them unqualified after a using-declaration of the std version.
+ *
+ * Accuracy, in units of the last place (1 LSB = 2^-F):
+ *  +, -            exact (saturating)
+ *  *, /            rounded, <= 1 LSB
+ *  sqrt            truncated, <= 1 LSB
+ *  sin, cos, atan2 CORDIC with 31 iterations in Q2.30, <= 2 LSB
+ *  asin            atan2(x, sqrt(1 - x^2)), <= 2 LSB for |x| <= 0.9 and <= 3 LSB for
+ *                  |x| < 0.99, degrading towards sqrt(LSB) as |x| approaches 1
+ * Q16.16 covers +-32768 at 1.5e-5 resolution, Q8.24 covers +-128 at 6e-8. Inputs to
+ * the filters must be scaled so that squared vector norms stay inside the range.
+ * Conversions from float and double are explicit and meant for setup and test code. They
+ * saturate out of range values and infinities, and convert NaN to 0.
+ */
+template <int F>
+class Fixed {
+    static_assert(F > 0 && F < 30, "Fixed<F> needs 0 < F < 30");
+private:
+    std::int32_t v;
+
+    static std::int32_t saturate(std::int64_t a);
+    static std::int64_t to_q30(std::int32_t a) {return static_cast<std::int64_t>(a)*(static_cast<std::int64_t>(1) << (30 - F));}
+    static std::int32_t from_q30(std::int64_t a) {return saturate((a + (static_cast<std::int64_t>(1) << (29 - F))) >> (30 - F));}
+    static std::int32_t sqrt_raw(std::int32_t a);
+    static void cordic_rotate(std::int64_t angle, std::int64_t& c, std::int64_t& s);
+    static std::int64_t cordic_vector(std::int64_t y, std::int64_t x);
+    static const std::int64_t atan_table[31];
+    static const std::int64_t cordic_gain = 652032874;      //0.6072529350 in Q30
+    static const std::int64_t pi_q30 = 3373259426;          //pi in Q30
+public:
+    static const int frac_bits = F;
+
+    Fixed() : v{0} {}
+    Fixed(int a) : v{saturate(static_cast<std::int64_t>(a)*(static_cast<std::int64_t>(1) << F))} {}
+    explicit Fixed(float a) : Fixed(static_cast<double>(a)) {}
+    explicit Fixed(double a);
+
+    static Fixed        from_raw(std::int32_t r)            {Fixed res; res.v = r; return res;}
+    static Fixed        max()                               {return from_raw(INT32_MAX);}
+    static Fixed        min()                               {return from_raw(INT32_MIN);}
+    static Fixed        epsilon()                           {return from_raw(1);}
+    std::int32_t        raw() const                         {return v;}
+    explicit operator   double() const                      {return static_cast<double>(v)/(static_cast<std::int64_t>(1) << F);}
+    explicit operator   float() const                       {return static_cast<float>(static_cast<double>(*this));}
+
+    Fixed&              operator+=(const Fixed& a)          {v = saturate(static_cast<std::int64_t>(v) + a.v); return *this;}
+    Fixed&              operator-=(const Fixed& a)          {v = saturate(static_cast<std::int64_t>(v) - a.v); return *this;}
+    Fixed&              operator*=(const Fixed& a);
+    Fixed&              operator/=(const Fixed& a);
+    Fixed               operator-() const                   {return from_raw(saturate(-static_cast<std::int64_t>(v)));}
+    Fixed               operator+() const                   {return *this;}
+
+    friend Fixed operator+(Fixed a, const Fixed& b)         {return a += b;}
+    friend Fixed operator-(Fixed a, const Fixed& b)         {return a -= b;}
+    friend Fixed operator*(Fixed a, const Fixed& b)         {return a *= b;}
+    friend Fixed operator/(Fixed a, const Fixed& b)         {return a /= b;}
+    friend bool  operator==(const Fixed& a, const Fixed& b) {return a.v == b.v;}
+    friend bool  operator!=(const Fixed& a, const Fixed& b) {return a.v != b.v;}
+    friend bool  operator< (const Fixed& a, const Fixed& b) {return a.v <  b.v;}
+    friend bool  operator<=(const Fixed& a, const Fixed& b) {return a.v <= b.v;}
+    friend bool  operator> (const Fixed& a, const Fixed& b) {return a.v >  b.v;}
+    friend bool  operator>=(const Fixed& a, const Fixed& b) {return a.v >= b.v;}
+
+    friend Fixed abs(const Fixed& a)                        {return a.v < 0 ? -a : a;}
+    friend Fixed sqrt(const Fixed& a)                       {return from_raw(sqrt_raw(a.v));}
+    friend Fixed sin(const Fixed& a)                        {std::int64_t c, s; cordic_rotate(to_q30(a.v), c, s); return from_raw(from_q30(s));}
+    friend Fixed cos(const Fixed& a)                        {std::int64_t c, s; cordic_rotate(to_q30(a.v), c, s); return from_raw(from_q30(c));}
+    friend Fixed atan2(const Fixed& y, const Fixed& x)      {return from_raw(from_q30(cordic_vector(y.v, x.v)));}
+    friend Fixed asin(const Fixed& a)                       {Fixed one{1}; Fixed x = a > one ? one : (a < -one ? -one : a); return atan2(x, sqrt(one - x*x));}
+};
+template <int F>
+const std::int64_t Fixed<F>::atan_table[31] = {
+    843314857, 497837829, 263043837, 133525159, 67021687, 33543516, 16775851, 8388437,
+    4194283, 2097149, 1048576, 524288, 262144, 131072, 65536, 32768,
+    16384, 8192, 4096, 2048, 1024, 512, 256, 128,
+    64, 32, 16, 8, 4, 2, 1};
+
+//Saturates like the arithmetic, NaN converts to 0
+template <int F>
+Fixed<F>::Fixed(double a)
+{
+    double r = std::round(a*static_cast<double>(static_cast<std::int64_t>(1) << F));
+    if(std::isnan(r))
+        v = 0;
+    else if(r >= static_cast<double>(INT32_MAX))
+        v = INT32_MAX;
+    else if(r <= static_cast<double>(INT32_MIN))
+        v = INT32_MIN;
+    else
+        v = static_cast<std::int32_t>(r);
+}
+template <int F>
+std::int32_t Fixed<F>::saturate(std::int64_t a)
+{
+    if(a > INT32_MAX) return INT32_MAX;
+    if(a < INT32_MIN) return INT32_MIN;
+    return static_cast<std::int32_t>(a);
+}
+template <int F>
+Fixed<F>& Fixed<F>::operator*=(const Fixed<F>& a)
+{
+    std::int64_t p = static_cast<std::int64_t>(v)*a.v;
+    v = saturate((p + (static_cast<std::int64_t>(1) << (F - 1))) >> F);
+    return *this;
+}
+template <int F>
+Fixed<F>& Fixed<F>::operator/=(const Fixed<F>& a)
+{
+    if(a.v == 0) {
+        v = v > 0 ? INT32_MAX : (v < 0 ? INT32_MIN : 0);
+        return *this;
+    }
+    std::int64_t n = static_cast<std::int64_t>(v)*(static_cast<std::int64_t>(1) << F);
+    std::int64_t q = n/a.v;
+    std::int64_t r = n%a.v;
+    //Round half away from zero
+    if(2*(r < 0 ? -r : r) >= (a.v < 0 ? -static_cast<std::int64_t>(a.v) : a.v))
+        q += ((n < 0) != (a.v < 0)) ? -1 : 1;
+    v = saturate(q);
+    return *this;
+}
+template <int F>
+std::int32_t Fixed<F>::sqrt_raw(std::int32_t a)
+{
+    if(a <= 0)
+        return 0;
+    //sqrt(a*2^-F)*2^F = sqrt(a*2^F)
+    std::uint64_t n = static_cast<std::uint64_t>(a) << F;
+    std::uint64_t res = 0;
+    std::uint64_t bit = static_cast<std::uint64_t>(1) << 62;
+#if defined(__GNUC__)
+    bit >>= (__builtin_clzll(n) & ~1);
+#else
+    while(bit > n)
+        bit >>= 2;
+#endif
+    while(bit) {
+        if(n >= res + bit) {
+            n -= res + bit;
+            res = (res >> 1) + bit;
+        } else {
+            res >>= 1;
+        }
+        bit >>= 2;
+    }
+    return saturate(static_cast<std::int64_t>(res));
+}
+//cos and sin of a Q30 angle, returned in Q30
+template <int F>
+void Fixed<F>::cordic_rotate(std::int64_t angle, std::int64_t& c, std::int64_t& s)
+{
+    //Reduce to [-pi, pi], then to [-pi/2, pi/2]
+    angle %= 2*pi_q30;
+    if(angle > pi_q30)  angle -= 2*pi_q30;
+    if(angle < -pi_q30) angle += 2*pi_q30;
+    bool flip = false;
+    if(angle > pi_q30/2)       {angle -= pi_q30; flip = true;}
+    else if(angle < -pi_q30/2) {angle += pi_q30; flip = true;}
+
+    std::int64_t x = cordic_gain;
+    std::int64_t y = 0;
+    //Branch free: m is 0 to rotate forward and -1 to rotate backward, (v ^ m) - m is +-v
+    for(int i = 0; i < 31; ++i) {
+        std::int64_t m = angle >> 63;
+        std::int64_t xs = x >> i;
+        std::int64_t ys = y >> i;
+        x -= (ys ^ m) - m;
+        y += (xs ^ m) - m;
+        angle -= (atan_table[i] ^ m) - m;
+    }
+    c = flip ? -x : x;
+    s = flip ? -y : y;
+}
+//atan2 of two raw values, returned as a Q30 angle
+template <int F>
+std::int64_t Fixed<F>::cordic_vector(std::int64_t y, std::int64_t x)
+{
+    if(x == 0 && y == 0)
+        return 0;
+    std::int64_t angle = 0;
+    if(x < 0) {
+        angle = y >= 0 ? pi_q30 : -pi_q30;
+        x = -x;
+        y = -y;
+    }
+    //Scale up for precision, the gain of 1.647 still fits comfortably in 64 bits
+    while((x < 0 ? -x : x) < (static_cast<std::int64_t>(1) << 40) && (y < 0 ? -y : y) < (static_cast<std::int64_t>(1) << 40)) {
+        x *= 2;
+        y *= 2;
+    }
+    for(int i = 0; i < 31; ++i) {
+        std::int64_t m = -static_cast<std::int64_t>(y <= 0);
+        std::int64_t xs = x >> i;
+        std::int64_t ys = y >> i;
+        x += (ys ^ m) - m;
+        y -= (xs ^ m) - m;
+        angle += (atan_table[i] ^ m) - m;
+    }
+    return angle;
+}
+template <int F>
+std::ostream& operator<<(std::ostream& os, const Fixed<F>& a)
+{
+    return os << static_cast<double>(a);
+}
+
+using Q16_16 = Fixed<16>;
+using Q8_24 = Fixed<24>;
+#endif // FIXED_POINT_H
@@ -0,0 +1,163 @@
+#ifndef INSTRUMENTATION_H
+#define INSTRUMENTATION_H
+#include <iostream>
+#include <cmath>
+#include <cstdint>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+#include "vec3.h"
+
+/*
+ * Instrumentation policies for ECF, Madgwick and attitude.
+ *
+ * The filters take the policy as their last template parameter and inherit it
+ * privately, so an empty policy adds no state. Hooks:
+ *  begin_update() / end_update(stamp)  around one filter or integrator update
+ *  on_normalize()                      every Unit_Quaternion normalization on the update path
+ *  on_innovation(v)                    the correction term (mes in ECF)
+ *  on_gradient(n)                      the gradient norm (f_norm in Madgwick)
+ *  on_skipped_correction()             an update that only propagated the gyro, see update_schedule.h
+ *  on_gated_sample()                   a sample with observations rejected by the gates of measurement_pipeline.h
+ *
+ * No_Instrumentation is the default. All of its hooks are empty inline functions,
+ * so the default build compiles to the same code as a filter without hooks.
+ */
+struct No_Instrumentation {
+    using stamp = int;
+    stamp begin_update() {return 0;}
+    void end_update(stamp) {}
+    void on_normalize() {}
+    template <typename T>
+    void on_innovation(const Vec3<T>&) {}
+    template <typename T>
+    void on_gradient(const T&) {}
+    void on_skipped_correction() {}
+    void on_gated_sample() {}
+};
+
+/*
+ * Running statistics of a non-negative quantity: count, mean, rms and max.
+ */
+struct Running_Stats {
+    std::uint64_t count;
+    double sum;
+    double sum_sq;
+    double max;
+
+    Running_Stats() : count{0}, sum{0}, sum_sq{0}, max{0} {}
+    void add(double v) {++count; sum += v; sum_sq += v*v; if(v > max) max = v;}
+    double mean() const {return count ? sum/count : 0;}
+    double rms() const  {return count ? std::sqrt(sum_sq/count) : 0;}
+};
+
+/*
+ * Latency histogram with power-of-two buckets: bucket i counts updates that took
+ * [2^i, 2^(i+1)) ticks. Ticks are TSC reference cycles on x86 and steady_clock
+ * nanoseconds elsewhere.
+ */
+struct Latency_Histogram {
+    static const unsigned int buckets = 32;
+    std::uint64_t bucket[buckets];
+    std::uint64_t count;
+    std::uint64_t total;
+    std::uint64_t min;
+    std::uint64_t max;
+
+    Latency_Histogram() : bucket{}, count{0}, total{0}, min{UINT64_MAX}, max{0} {}
+    void add(std::uint64_t ticks);
+    double mean() const {return count ? static_cast<double>(total)/count : 0;}
+    std::uint64_t percentile(double p) const;
+};
+inline void Latency_Histogram::add(std::uint64_t ticks)
+{
+    unsigned int i = 0;
+#if defined(__GNUC__)
+    if(ticks)
+        i = 63 - __builtin_clzll(ticks);
+#else
+    for(std::uint64_t t = ticks; t >>= 1;)
+        ++i;
+#endif
+    if(i >= buckets)
+        i = buckets - 1;
+    ++bucket[i];
+    ++count;
+    total += ticks;
+    if(ticks < min) min = ticks;
+    if(ticks > max) max = ticks;
+}
+//Upper edge of the bucket holding the p-quantile, p in [0,1]
+inline std::uint64_t Latency_Histogram::percentile(double p) const
+{
+    std::uint64_t target = static_cast<std::uint64_t>(std::ceil(p*count));
+    std::uint64_t seen = 0;
+    for(unsigned int i = 0; i < buckets; ++i) {
+        seen += bucket[i];
+        if(seen >= target && seen)
+            return (static_cast<std::uint64_t>(2) << i) - 1;
+    }
+    return max;
+}
+
+inline std::uint64_t read_ticks()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+/*
+ * Per-instance counters, update latency histogram and innovation statistics.
+ */
+struct Counting_Instrumentation {
+    using stamp = std::uint64_t;
+    std::uint64_t updates;
+    std::uint64_t normalizations;
+    std::uint64_t skipped;
+    std::uint64_t gated;
+    Latency_Histogram latency;
+    Running_Stats innovation;
+    Running_Stats gradient;
+
+    Counting_Instrumentation() : updates{0}, normalizations{0}, skipped{0}, gated{0} {}
+    void reset() {*this = Counting_Instrumentation{};}
+
+    stamp begin_update() {return read_ticks();}
+    void end_update(stamp s) {latency.add(read_ticks() - s); ++updates;}
+    void on_normalize() {++normalizations;}
+    template <typename T>
+    void on_innovation(const Vec3<T>& v);
+    template <typename T>
+    void on_gradient(const T& n) {gradient.add(static_cast<double>(n));}
+    void on_skipped_correction() {++skipped;}
+    void on_gated_sample() {++gated;}
+};
+template <typename T>
+void Counting_Instrumentation::on_innovation(const Vec3<T>& v)
+{
+    double x = static_cast<double>(v[0]);
+    double y = static_cast<double>(v[1]);
+    double z = static_cast<double>(v[2]);
+    innovation.add(std::sqrt(x*x + y*y + z*z));
+}
+
+inline std::ostream& operator<<(std::ostream& os, const Running_Stats& s)
+{
+    return os << "{n: " << s.count << ", mean: " << s.mean() << ", rms: " << s.rms() << ", max: " << s.max << "}";
+}
+inline std::ostream& operator<<(std::ostream& os, const Counting_Instrumentation& c)
+{
+    os << "Instrumentation: {updates: " << c.updates << ", normalizations: " << c.normalizations << ", skipped corrections: " << c.skipped << ", gated samples: " << c.gated << "}\n";
+    os << "  latency [ticks]: {mean: " << c.latency.mean() << ", min: " << (c.latency.count ? c.latency.min : 0)
+       << ", p50 <= " << c.latency.percentile(0.5) << ", p99 <= " << c.latency.percentile(0.99)
+       << ", max: " << c.latency.max << "}\n";
+    os << "  innovation: " << c.innovation << '\n';
+    return os << "  gradient:   " << c.gradient;
+}
+#endif // INSTRUMENTATION_H
@@ -0,0 +1,150 @@
+#ifndef INTERPOLATION_H
+#define INTERPOLATION_H
+#include <cassert>
+#include <cstddef>
+#include <cmath>
+#include <algorithm>
+#include "quaternion.h"
+#include "vec3.h"
+#include "fast_math.h"
+
+/*
+ * Interpolation between unit quaternions, always along the shorter arc.
+ *
+ * slerp    exact constant rate interpolation
+ * nlerp    normalized linear interpolation with a corrected parameter,
+ *          t' = t + t(t - 1/2)(t - 1)k(d, (t - 1/2)^2), d = |<p,q>|, where k is a fit
+ *          of the exact correction. Angular error against slerp for a rotation of theta
+ *          between p and q: <= 2e-7 rad for theta <= 1 rad and <= 4.1e-6 rad for
+ *          theta <= pi/2 (nlerp_max_angle). Beyond that it grows to 3.7e-3 rad at pi.
+ * squad    C1 smooth spline through a sequence of samples, with the inner control
+ *          points from squad_control
+ * resample maps a sorted stream of query timestamps onto a sampled quaternion track
+ *          in one linear pass. Segments of up to nlerp_max_angle use the vectorized
+ *          nlerp kernel, wider segments fall back to slerp, so the error bound of nlerp
+ *          holds for every output sample.
+ */
+const double nlerp_max_angle = 1.57079632679489661923;
+
+template <typename T>
+inline T nlerp_parameter(const T& d, const T& t)
+{
+    T h = t - static_cast<T>(0.5);
+    T u = h*h;
+    T k = static_cast<T>(0.84080643671214) + d*(static_cast<T>(-1.0568014874935834) + d*(static_cast<T>(0.2579129237913079) + d*static_cast<T>(-0.04191840733872649)))
+          + u*(static_cast<T>(0.8837655192504817) + d*(static_cast<T>(-2.131578430157541) + d*(static_cast<T>(1.612680745026079) + d*static_cast<T>(-0.3648748800811386))));
+    return t + t*h*(t - 1)*k;
+}
+template <typename T>
+Unit_Quaternion<T> nlerp(const Unit_Quaternion<T>& p, const Unit_Quaternion<T>& q, const T& t)
+{
+    T d = p[0]*q[0] + p[1]*q[1] + p[2]*q[2] + p[3]*q[3];
+    T s = d < 0 ? static_cast<T>(-1) : static_cast<T>(1);
+    T tc = nlerp_parameter(s*d, t);
+    T a = 1 - tc;
+    T b = s*tc;
+    return {a*p[0] + b*q[0], a*p[1] + b*q[1], a*p[2] + b*q[2], a*p[3] + b*q[3]};
+}
+template <typename T>
+Unit_Quaternion<T> slerp(const Unit_Quaternion<T>& p, const Unit_Quaternion<T>& q, const T& t)
+{
+    using std::sqrt;
+    using std::sin;
+    using std::atan2;
+    T d = p[0]*q[0] + p[1]*q[1] + p[2]*q[2] + p[3]*q[3];
+    T s = d < 0 ? static_cast<T>(-1) : static_cast<T>(1);
+    d *= s;
+    //sin(theta) vanishes, the corrected nlerp is exact to rounding there
+    if(d > static_cast<T>(0.9995))
+        return nlerp(p, q, t);
+    T theta = atan2(sqrt(1 - d*d), d);
+    //The common factor 1/sin(theta) is removed by the normalization
+    T a = sin((1 - t)*theta);
+    T b = s*sin(t*theta);
+    return {a*p[0] + b*q[0], a*p[1] + b*q[1], a*p[2] + b*q[2], a*p[3] + b*q[3]};
+}
+//Inner control point for q between q_prev and q_next: q*exp(-(log(q^-1 q_next) + log(q^-1 q_prev))/4)
+template <typename T>
+Unit_Quaternion<T> squad_control(const Unit_Quaternion<T>& q_prev, const Unit_Quaternion<T>& q, const Unit_Quaternion<T>& q_next)
+{
+    Unit_Quaternion<T> q_inv = conjugate(q);
+    Vec3<T> l = logq(q_inv*q_next) + logq(q_inv*q_prev);
+    return q*expq(static_cast<T>(-1)/4*l);
+}
+//Interpolates from q0 to q1, a0 and a1 are squad_control of q0 and q1
+template <typename T>
+Unit_Quaternion<T> squad(const Unit_Quaternion<T>& q0, const Unit_Quaternion<T>& a0, const Unit_Quaternion<T>& a1, const Unit_Quaternion<T>& q1, const T& t)
+{
+    return slerp(slerp(q0, q1, t), slerp(a0, a1, t), 2*t*(1 - t));
+}
+
+/*
+ * Batch nlerp over structure-of-arrays input, out = nlerp(a, b, t), the arrays must not overlap.
+ */
+template <typename T>
+void nlerp(const T* ATT_RESTRICT aw, const T* ATT_RESTRICT ax, const T* ATT_RESTRICT ay, const T* ATT_RESTRICT az,
+           const T* ATT_RESTRICT bw, const T* ATT_RESTRICT bx, const T* ATT_RESTRICT by, const T* ATT_RESTRICT bz,
+           const T* ATT_RESTRICT t, T* ATT_RESTRICT ow, T* ATT_RESTRICT ox, T* ATT_RESTRICT oy, T* ATT_RESTRICT oz, std::size_t n)
+{
+    using std::sqrt;
+    for(std::size_t k = 0; k < n; ++k) {
+        T d = aw[k]*bw[k] + ax[k]*bx[k] + ay[k]*by[k] + az[k]*bz[k];
+        T s = d < 0 ? static_cast<T>(-1) : static_cast<T>(1);
+        T tc = nlerp_parameter(s*d, t[k]);
+        T a = 1 - tc;
+        T b = s*tc;
+        T w = a*aw[k] + b*bw[k];
+        T x = a*ax[k] + b*bx[k];
+        T y = a*ay[k] + b*by[k];
+        T z = a*az[k] + b*bz[k];
+        T inv = 1/sqrt(w*w + x*x + y*y + z*z);
+        ow[k] = w*inv; ox[k] = x*inv; oy[k] = y*inv; oz[k] = z*inv;
+    }
+}
+/*
+ * q_out[i] = attitude at t_query[i] of the track (t_src, q_src). Both timestamp arrays
+ * must be sorted ascending; queries outside the track are clamped to its ends.
+ * The interpolation parameter is computed in Time: float timestamps resolve only about
+ * 1e-3 s at t = 1e4 s, so long or epoch based logs should keep them in double.
+ */
+template <typename T, typename Time = double>
+void resample(const Time* t_src, const Unit_Quaternion<T>* q_src, std::size_t n_src,
+              const Time* t_query, Unit_Quaternion<T>* q_out, std::size_t n_query)
+{
+    assert(n_src > 0);
+    using std::cos;
+    const T d_min = static_cast<T>(cos(nlerp_max_angle/2));
+    T aw[batch_block], ax[batch_block], ay[batch_block], az[batch_block];
+    T bw[batch_block], bx[batch_block], by[batch_block], bz[batch_block];
+    T u[batch_block], ow[batch_block], ox[batch_block], oy[batch_block], oz[batch_block];
+    std::size_t wide[batch_block];
+    std::size_t j = 0;
+    for(std::size_t i = 0; i < n_query; i += batch_block) {
+        std::size_t m = std::min(batch_block, n_query - i);
+        std::size_t n_wide = 0;
+        for(std::size_t k = 0; k < m; ++k) {
+            Time tq = t_query[i + k];
+            while(j + 1 < n_src && t_src[j + 1] <= tq)
+                ++j;
+            std::size_t j1 = j + 1 < n_src ? j + 1 : j;
+            Time span = t_src[j1] - t_src[j];
+            Time uk = span > 0 ? (tq - t_src[j])/span : static_cast<Time>(0);
+            u[k] = static_cast<T>(std::min(std::max(uk, static_cast<Time>(0)), static_cast<Time>(1)));
+            const Unit_Quaternion<T>& a = q_src[j];
+            const Unit_Quaternion<T>& b = q_src[j1];
+            aw[k] = a[0]; ax[k] = a[1]; ay[k] = a[2]; az[k] = a[3];
+            bw[k] = b[0]; bx[k] = b[1]; by[k] = b[2]; bz[k] = b[3];
+            T d = aw[k]*bw[k] + ax[k]*bx[k] + ay[k]*by[k] + az[k]*bz[k];
+            if(d < d_min && -d < d_min)
+                wide[n_wide++] = k;
+        }
+        nlerp(aw, ax, ay, az, bw, bx, by, bz, u, ow, ox, oy, oz, m);
+        for(std::size_t k = 0; k < m; ++k)
+            assign_unit(q_out[i + k], ow[k], ox[k], oy[k], oz[k]);
+        for(std::size_t w = 0; w < n_wide; ++w) {
+            std::size_t k = wide[w];
+            q_out[i + k] = slerp(Unit_Quaternion<T>{aw[k], ax[k], ay[k], az[k]}, Unit_Quaternion<T>{bw[k], bx[k], by[k], bz[k]}, u[k]);
+        }
+    }
+}
+#endif // INTERPOLATION_H
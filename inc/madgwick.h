@@ -4,6 +4,9 @@
 #include "quaternion.h"
 #include "vec3.h"
 #include "mat3.h"
+#include "instrumentation.h"
+#include "update_schedule.h"
+#include "measurement_pipeline.h"
 /*
  * Constructor
  * Reset filter
@@ -11,8 +14,8 @@
  * get state
  */
 
-template <typename T>
-class Madgwick {
+template <typename T, typename Instrumentation = No_Instrumentation>
+class Madgwick : private Instrumentation {
 private:
     Unit_Quaternion<T> q;
     Vec3<T> b_w;
@@ -20,65 +23,219 @@ private:
     T beta;
     T zeta;
     unsigned int i;
+    Update_Schedule<T> schedule;
+    Vec3<T> a_sum;
+    Vec3<T> m_sum;
+    //Time integrals of |a|^2 and |m|^2, for the spread of the observations around a_sum and m_sum
+    T a_sq_sum;
+    T m_sq_sum;
+    //Gradient steps of the skipped samples, taken by the next correction
+    T step_sum;
 public:
-    Madgwick() : q{1,0,0,0}, b_w{0,0,0}, alpha{2}, beta{2}, zeta{2} {}
+    Madgwick() : q{1,0,0,0}, b_w{0,0,0}, alpha{2}, beta{2}, zeta{2}, a_sum{0,0,0}, m_sum{0,0,0}, a_sq_sum{0}, m_sq_sum{0}, step_sum{0} {}
     Unit_Quaternion<T> get_attitude() {return q;}
     Vec3<T> get_bias() {return b_w;}
+    const Instrumentation& get_instrumentation() const {return *this;}
+    Instrumentation& get_instrumentation() {return *this;}
 
-    Madgwick(Madgwick<T>& f) = delete;
-    Madgwick<T>& operator=(Madgwick<T>& f) = delete;
-    Madgwick(Madgwick<T>&& f) = delete;
-    Madgwick<T>& operator=(Madgwick<T>&& f) = delete;
+    Madgwick(Madgwick<T,Instrumentation>& f) = delete;
+    Madgwick<T,Instrumentation>& operator=(Madgwick<T,Instrumentation>& f) = delete;
+    Madgwick(Madgwick<T,Instrumentation>&& f) = delete;
+    Madgwick<T,Instrumentation>& operator=(Madgwick<T,Instrumentation>&& f) = delete;
 
     void set_gains(T alpha, T beta, T zeta);
-    void reset_filter() {q = {1,0,0,0}; b_w = {0,0,0};}
+    //See update_schedule.h, disabled by default
+    void set_schedule(T gyro_threshold, T innovation_threshold, unsigned int max_skip, T max_interval);
+    void reset_filter();
     void set_reference_vectors(Vec3<T> a, Vec3<T> m);
     void update_filter(Vec3<T> w, T dt, Vec3<T> a, Vec3<T> m);
+    //Corrects only if both a and m passed the gates, see measurement_pipeline.h
+    void update_filter(const Preprocessed_Sample<T>& s);
 private:
+    void filter_step(const Vec3<T>& w, const T& dt, Vec3<T> a, Vec3<T> m, bool normalized);
+    void gradient_step(const Vec3<T>& w, const T& dt, Vec3<T> a, Vec3<T> m, bool normalized, bool scheduled, const T& spread_sq);
     void set_Ks(T k);
     void update_attitude(const Vec3<T>& w, const T& dt);
     Quaternion<T> attitude_kinematics(const Unit_Quaternion<T>& q, const Vec3<T>& w);
     Unit_Quaternion<T> integrate_euler(const Unit_Quaternion<T>& q, const Vec3<T>& w, const T& dt);
 };
-template <typename T>
-void Madgwick<T>::set_gains(T alpha, T beta, T zeta)
+template <typename T, typename Instrumentation>
+void Madgwick<T,Instrumentation>::set_gains(T alpha, T beta, T zeta)
 {
     this->alpha = alpha;
     this->beta = beta;
     this->zeta = zeta;
 }
-template <typename T>
-void Madgwick<T>::update_filter(Vec3<T> w, T dt, Vec3<T> a, Vec3<T> m)
+template <typename T, typename Instrumentation>
+void Madgwick<T,Instrumentation>::set_schedule(T gyro_threshold, T innovation_threshold, unsigned int max_skip, T max_interval)
 {
+    schedule.configure(gyro_threshold, innovation_threshold, max_skip, max_interval);
+    a_sum = {0,0,0};
+    m_sum = {0,0,0};
+    a_sq_sum = 0;
+    m_sq_sum = 0;
+    step_sum = 0;
+}
+template <typename T, typename Instrumentation>
+void Madgwick<T,Instrumentation>::reset_filter()
+{
+    q = {1,0,0,0};
+    b_w = {0,0,0};
+    schedule.reset();
+    a_sum = {0,0,0};
+    m_sum = {0,0,0};
+    a_sq_sum = 0;
+    m_sq_sum = 0;
+    step_sum = 0;
+}
+template <typename T, typename Instrumentation>
+void Madgwick<T,Instrumentation>::update_filter(Vec3<T> w, T dt, Vec3<T> a, Vec3<T> m)
+{
+    auto stamp = this->begin_update();
+    filter_step(w, dt, a, m, false);
+    this->end_update(stamp);
+}
+template <typename T, typename Instrumentation>
+void Madgwick<T,Instrumentation>::update_filter(const Preprocessed_Sample<T>& s)
+{
+    auto stamp = this->begin_update();
+    if(s.a_valid && s.m_valid) {
+        filter_step(s.w, s.dt, s.a_hat(), s.m_hat(), true);
+    } else {
+        //Gyro only, rotate the sums of skipped observations into the new body frame
+        this->on_gated_sample();
+        if(schedule.enabled())
+            schedule.gated(s.dt);
+        if(schedule.skipped_in_row()) {
+            accumulate_observation(a_sum, s.w - b_w, s.dt, Vec3<T>{0,0,0});
+            accumulate_observation(m_sum, s.w - b_w, s.dt, Vec3<T>{0,0,0});
+        }
+        update_attitude(s.w - b_w, s.dt);
+    }
+    this->end_update(stamp);
+}
+//normalized: a and m are of unit length already
+template <typename T, typename Instrumentation>
+void Madgwick<T,Instrumentation>::filter_step(const Vec3<T>& w, const T& dt, Vec3<T> a, Vec3<T> m, bool normalized)
+{
+    using std::sqrt;
+    if(!schedule.enabled()) {
+        gradient_step(w, dt, a, m, normalized, false, 0);
+        return;
+    }
+    if(schedule.skip(w - b_w, dt)) {
+        this->on_skipped_correction();
+        //The gyro share of the fused step, its gradient share is left to the next correction.
+        //The observations turn with the attitude, by the gyro share
+        auto dot_q = attitude_kinematics(q, w - b_w);
+        T mu = alpha*sqrt(dot_q[0]*dot_q[0] + dot_q[1]*dot_q[1] + dot_q[2]*dot_q[2] + dot_q[3]*dot_q[3])*dt;
+        T y = beta/(mu/dt + beta);
+        step_sum += y*mu;
+        accumulate_observation(a_sum, (1 - y)*(w - b_w), dt, a);
+        accumulate_observation(m_sum, (1 - y)*(w - b_w), dt, m);
+        a_sq_sum += dt*dot(a,a);
+        m_sq_sum += dt*dot(m,m);
+        this->on_normalize();
+        q = Unit_Quaternion<T>{Quaternion<T>{q} + (1 - y)*dt*dot_q};
+        return;
+    }
+    //Squared angular spread of the single samples around their average
+    T spread_sq = 0;
+    if(schedule.skipped_in_row()) {
+        T dt_c = schedule.correction_dt();
+        accumulate_observation(a_sum, w - b_w, dt, a);
+        accumulate_observation(m_sum, w - b_w, dt, m);
+        a_sq_sum += dt*dot(a,a);
+        m_sq_sum += dt*dot(m,m);
+        spread_sq = dt_c*a_sq_sum/dot(a_sum,a_sum) + dt_c*m_sq_sum/dot(m_sum,m_sum) - 2;
+        a = a_sum;
+        m = m_sum;
+        a_sum = {0,0,0};
+        m_sum = {0,0,0};
+        a_sq_sum = 0;
+        m_sq_sum = 0;
+        normalized = false;
+    }
+    gradient_step(w, dt, a, m, normalized, true, spread_sq);
+}
+//scheduled: the correction also covers the skipped samples, whose observations spread by
+//spread_sq around a and m, and reports to the schedule
+template <typename T, typename Instrumentation>
+void Madgwick<T,Instrumentation>::gradient_step(const Vec3<T>& w, const T& dt, Vec3<T> a, Vec3<T> m, bool normalized, bool scheduled, const T& spread_sq)
+{
+    using std::sqrt;
+    using std::min;
     //Gradient descent
     Quaternion<T> q_G{q};
 
-    Vec3<T> a_hat = a/a.magnitude();
+    Vec3<T> a_hat = normalized ? a : a/a.magnitude();
     Vec3<T> a_ref = rotate_vec(conjugate(q),Vec3<T>{0,0,1});
 
-    Vec3<T> m_hat = m/m.magnitude();
+    Vec3<T> m_hat = normalized ? m : m/m.magnitude();
     Vec3<T> m_i = rotate_vec(q,m_hat);
-    Vec3<T> m_ref = rotate_vec(conjugate(q),Vec3<T>{std::sqrt(m_i[0]*m_i[0]+m_i[1]*m_i[1]),0,m_i[2]});
+    Vec3<T> m_ref = rotate_vec(conjugate(q),Vec3<T>{sqrt(m_i[0]*m_i[0]+m_i[1]*m_i[1]),0,m_i[2]});
 
-    T f0 = dot({-2*q_G[2], 2*q_G[1],         0}, a_ref - a_hat)
-            + dot({-2*m_ref[2]*q_G[2],-2*m_ref[0]*q_G[3]+2*m_ref[2]*q_G[1],2*m_ref[0]*q_G[2]}, m_ref - m_hat);
-    T f1 = dot({ 2*q_G[3], 2*q_G[0], -4*q_G[1]}, a_ref - a_hat)
-            + dot({2*m_ref[2]*q_G[3],2*m_ref[0]*q_G[2]+2*m_ref[2]*q_G[0],2*m_ref[0]*q_G[3]-4*m_ref[2]*q_G[1]}, m_ref - m_hat);
-    T f2 = dot({-2*q_G[0], 2*q_G[3],  4*q_G[2]}, a_ref - a_hat)
-            + dot({-m_ref[0]*q_G[2]-2*m_ref[2]*q_G[0],2*m_ref[0]*q_G[1]+2*m_ref[2]*q_G[3],2*m_ref[0]*q_G[0]-4*m_ref[2]*q_G[2]}, m_ref - m_hat);
-    T f3 = dot({ 2*q_G[1], 2*q_G[2],         0}, a_ref - a_hat)
-            + dot({-4*m_ref[0]*q_G[3]+2*m_ref[2]*q_G[1],-2*m_ref[0]*q_G[0]+2*m_ref[2]*q_G[2],2*m_ref[0]*q_G[1]}, m_ref - m_hat);
+    //Columns of the Jacobian of the residuals a_ref - a_hat and m_ref - m_hat
+    const Vec3<T> J_a[4] = {{-2*q_G[2], 2*q_G[1],         0},
+                            { 2*q_G[3], 2*q_G[0], -4*q_G[1]},
+                            {-2*q_G[0], 2*q_G[3],  4*q_G[2]},
+                            { 2*q_G[1], 2*q_G[2],         0}};
+    const Vec3<T> J_m[4] = {{-2*m_ref[2]*q_G[2],-2*m_ref[0]*q_G[3]+2*m_ref[2]*q_G[1],2*m_ref[0]*q_G[2]},
+                            {2*m_ref[2]*q_G[3],2*m_ref[0]*q_G[2]+2*m_ref[2]*q_G[0],2*m_ref[0]*q_G[3]-4*m_ref[2]*q_G[1]},
+                            {-m_ref[0]*q_G[2]-2*m_ref[2]*q_G[0],2*m_ref[0]*q_G[1]+2*m_ref[2]*q_G[3],2*m_ref[0]*q_G[0]-4*m_ref[2]*q_G[2]},
+                            {-4*m_ref[0]*q_G[3]+2*m_ref[2]*q_G[1],-2*m_ref[0]*q_G[0]+2*m_ref[2]*q_G[2],2*m_ref[0]*q_G[1]}};
 
-    T f_norm = std::sqrt(f0*f0 + f1*f1 + f2*f2 + f3*f3);
+    T f0 = dot(J_a[0], a_ref - a_hat) + dot(J_m[0], m_ref - m_hat);
+    T f1 = dot(J_a[1], a_ref - a_hat) + dot(J_m[1], m_ref - m_hat);
+    T f2 = dot(J_a[2], a_ref - a_hat) + dot(J_m[2], m_ref - m_hat);
+    T f3 = dot(J_a[3], a_ref - a_hat) + dot(J_m[3], m_ref - m_hat);
+
+    T f_norm = sqrt(f0*f0 + f1*f1 + f2*f2 + f3*f3);
+    this->on_gradient(f_norm);
 
     //Prediction from angular velocity
     Vec3<T> w_q = quat_to_vec(static_cast<T>(2)*conjugate(q_G)*Quaternion<T>{f0/f_norm,f1/f_norm,f2/f_norm,f3/f_norm});
-    b_w += zeta*w_q*dt;
+    //Time the bias integrates over, dt unless corrections were skipped
+    T dt_b = dt;
+    T reach = 0;
+    T g_norm = 0;
+    T aligned = 1;
+    if(scheduled) {
+        //Distance along the gradient to the minimum of the linearized residuals. Twice it
+        //is the attitude error in rad the schedule compares against its threshold
+        //The part of the gradient along q only scales q and is normalized away
+        T f_q = f0*q_G[0] + f1*q_G[1] + f2*q_G[2] + f3*q_G[3];
+        T g0 = f0 - f_q*q_G[0], g1 = f1 - f_q*q_G[1], g2 = f2 - f_q*q_G[2], g3 = f3 - f_q*q_G[3];
+        Vec3<T> Jg_a = g0*J_a[0] + g1*J_a[1] + g2*J_a[2] + g3*J_a[3];
+        Vec3<T> Jg_m = g0*J_m[0] + g1*J_m[1] + g2*J_m[2] + g3*J_m[3];
+        g_norm = sqrt(g0*g0 + g1*g1 + g2*g2 + g3*g3);
+        reach = g_norm*g_norm*g_norm/(dot(Jg_a,Jg_a) + dot(Jg_m,Jg_m));
+        T dt_c = schedule.correction_dt();
+        schedule.corrected(4*reach*reach);
+        //The consecutive corrections would each have followed the gradient of a single noisy
+        //sample. On average they point at the minimum by reach/sqrt(reach^2 + noise^2), with
+        //the noise of that distance estimated from the spread of the samples
+        if(step_sum > 0) {
+            T noise_sq = spread_sq > 0 ? spread_sq/12 : 0;
+            aligned = reach/sqrt(reach*reach + noise_sq);
+            dt_b = aligned*dt_c;
+        }
+    }
+    b_w += zeta*w_q*dt_b;
 
     auto dot_q = attitude_kinematics(q, w - b_w);
     Quaternion<T> q_w = Quaternion<T>{q} + dt*dot_q;
 
-    T mu = alpha*std::sqrt(dot_q[0]*dot_q[0] + dot_q[1]*dot_q[1] + dot_q[2]*dot_q[2] + dot_q[3]*dot_q[3])*dt;
+    T mu = alpha*sqrt(dot_q[0]*dot_q[0] + dot_q[1]*dot_q[1] + dot_q[2]*dot_q[2] + dot_q[3]*dot_q[3])*dt;
+
+    T y = beta/(mu/dt + beta);
+
+    if(step_sum > 0) {
+        //Take the steps of the skipped samples too, stopping at the minimum. A step of mu
+        //along the gradient moves q by mu*|g|/|f| in attitude
+        mu = min(aligned*(mu + step_sum/y), reach*f_norm/(y*g_norm));
+        step_sum = 0;
+    }
 
     T q0 = q_G[0] - mu*f0/f_norm;
     T q1 = q_G[1] - mu*f1/f_norm;
@@ -87,27 +244,27 @@ void Madgwick<T>::update_filter(Vec3<T> w, T dt, Vec3<T> a, Vec3<T> m)
 
     q_G = {q0,q1,q2,q3};
 
-    T y = beta/(mu/dt + beta);
-
+    this->on_normalize();
     q = Unit_Quaternion<T>{y*q_G + (1 - y)*q_w};
 }
-template <typename T>
-void Madgwick<T>::update_attitude(const Vec3<T>& w, const T& dt)
+template <typename T, typename Instrumentation>
+void Madgwick<T,Instrumentation>::update_attitude(const Vec3<T>& w, const T& dt)
 {
     q = integrate_euler(q, w, dt);
 }
-template <typename T>
-Quaternion<T> Madgwick<T>::attitude_kinematics(const Unit_Quaternion<T>& q, const Vec3<T>& w)
+template <typename T, typename Instrumentation>
+Quaternion<T> Madgwick<T,Instrumentation>::attitude_kinematics(const Unit_Quaternion<T>& q, const Vec3<T>& w)
 {
     Quaternion<T> qw{w};
     return static_cast<T>(1)/2*(q*qw);
 }
-template <typename T>
-Unit_Quaternion<T> Madgwick<T>::integrate_euler(const Unit_Quaternion<T>& q, const Vec3<T>& w, const T& dt)
+template <typename T, typename Instrumentation>
+Unit_Quaternion<T> Madgwick<T,Instrumentation>::integrate_euler(const Unit_Quaternion<T>& q, const Vec3<T>& w, const T& dt)
 {
     Quaternion<T> p{q};
     Quaternion<T> dot_q = attitude_kinematics(q, w);
     p += dot_q*dt;
+    this->on_normalize();
     return {p};
 }
 #endif // MADGWICK_H
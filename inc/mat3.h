@@ -24,6 +24,7 @@ public:
     Mat3(std::initializer_list<T> l) = delete;
 
     T&      operator()(unsigned int i, unsigned int j)      {assert(i < 3 && j < 3); return A[i*3+j];}
+    T       operator()(unsigned int i, unsigned int j) const{assert(i < 3 && j < 3); return A[i*3+j];}
 };
 template <typename T>
 Mat3<T>::Mat3()
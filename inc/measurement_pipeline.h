@@ -0,0 +1,143 @@
+#ifndef MEASUREMENT_PIPELINE_H
+#define MEASUREMENT_PIPELINE_H
+#include <cmath>
+#include "vec3.h"
+
+/*
+ * Shared preprocessing of one IMU stream for several filters.
+ *
+ * Measurement_Preprocessor computes the per-sample quantities that do not depend on a
+ * filter's state and the gating flags. Filter_Set hands the result to every filter through
+ * update_filter(const Preprocessed_Sample<T>&), which ECF<T,2> and Madgwick provide, so
+ * that all of them see the same gating decisions. The normalized vectors, magnitudes and
+ * inclination are computed on first use, by a gate or a filter, and shared with the
+ * consumers that follow; without gates process() only tests for zero vectors. ECF takes
+ * the raw a and m and matches its direct update_filter(), Madgwick takes a_hat and m_hat
+ * and normalizes once per sample however many Madgwick filters the set holds. The
+ * attitude and bias dependent work of the filters cannot be shared, so a set costs what
+ * separate updates do, and less once gates reject samples (attitude_bench).
+ *
+ * Gating rejects an observation whose magnitude deviates from the expected one by more
+ * than the relative tolerance (linear acceleration, magnetic disturbance), or a
+ * magnetometer sample whose inclination is off by more than the given angle. Zero vectors
+ * are always rejected. The filters skip the correction from rejected observations and
+ * propagate the gyro only; ECF still uses the valid one of the two.
+ * By default nothing but zero vectors is gated.
+ */
+template <typename T>
+class Preprocessed_Sample {
+public:
+    Vec3<T> w;
+    T dt;
+    Vec3<T> a;
+    Vec3<T> m;
+    bool a_valid;
+    bool m_valid;
+
+    Preprocessed_Sample(const Vec3<T>& w, const T& dt, const Vec3<T>& a, const Vec3<T>& m)
+        : w(w), dt{dt}, a(a), m(m), a_valid{true}, m_valid{true}, a_length{0}, m_length{0}, a_done{false}, m_done{false} {}
+
+    //Computed on first use and shared by the consumers that follow, zero for a zero vector
+    T a_norm() const                {normalize(a, a_unit, a_length, a_done); return a_length;}
+    T m_norm() const                {normalize(m, m_unit, m_length, m_done); return m_length;}
+    const Vec3<T>& a_hat() const    {normalize(a, a_unit, a_length, a_done); return a_unit;}
+    const Vec3<T>& m_hat() const    {normalize(m, m_unit, m_length, m_done); return m_unit;}
+    //Sine of the angle of m below the plane normal to a, positive when m points away from a
+    T sin_inclination() const       {return -dot(a_hat(), m_hat());}
+    T inclination() const           {using std::asin; return asin(sin_inclination());}
+private:
+    mutable Vec3<T> a_unit;
+    mutable Vec3<T> m_unit;
+    mutable T a_length;
+    mutable T m_length;
+    mutable bool a_done;
+    mutable bool m_done;
+
+    static void normalize(const Vec3<T>& v, Vec3<T>& unit, T& length, bool& done);
+};
+template <typename T>
+void Preprocessed_Sample<T>::normalize(const Vec3<T>& v, Vec3<T>& unit, T& length, bool& done)
+{
+    using std::sqrt;
+    if(done)
+        return;
+    length = sqrt(dot(v,v));
+    //One division per vector instead of one per component
+    unit = length > 0 ? (static_cast<T>(1)/length)*v : Vec3<T>{0,0,0};
+    done = true;
+}
+
+template <typename T>
+class Measurement_Preprocessor {
+private:
+    bool gate_a;
+    T g;
+    T a_tolerance;
+    bool gate_m;
+    T field;
+    T m_tolerance;
+    bool gate_inclination;
+    //Inclination window as sines, asin is monotonic
+    T sin_min;
+    T sin_max;
+public:
+    Measurement_Preprocessor() : gate_a{false}, g{1}, a_tolerance{0}, gate_m{false}, field{1}, m_tolerance{0},
+                                 gate_inclination{false}, sin_min{-1}, sin_max{1} {}
+
+    void set_accel_gate(T g, T tolerance)                   {gate_a = true; this->g = g; a_tolerance = tolerance;}
+    void set_mag_gate(T field, T tolerance)                 {gate_m = true; this->field = field; m_tolerance = tolerance;}
+    void set_inclination_gate(T inclination, T tolerance);
+    void clear_gates()                                      {gate_a = false; gate_m = false; gate_inclination = false;}
+
+    Preprocessed_Sample<T> process(const Vec3<T>& w, const T& dt, const Vec3<T>& a, const Vec3<T>& m) const;
+};
+template <typename T>
+void Measurement_Preprocessor<T>::set_inclination_gate(T inclination, T tolerance)
+{
+    using std::sin;
+    const T pi_2 = static_cast<T>(1.57079632679489661923);
+    gate_inclination = true;
+    sin_min = inclination - tolerance > -pi_2 ? sin(inclination - tolerance) : static_cast<T>(-1);
+    sin_max = inclination + tolerance < pi_2 ? sin(inclination + tolerance) : static_cast<T>(1);
+}
+template <typename T>
+Preprocessed_Sample<T> Measurement_Preprocessor<T>::process(const Vec3<T>& w, const T& dt, const Vec3<T>& a, const Vec3<T>& m) const
+{
+    using std::abs;
+    Preprocessed_Sample<T> s{w, dt, a, m};
+    //Without gates a zero test is enough, the norms are left to the filters that need them
+    s.a_valid = gate_a ? s.a_norm() > 0 && abs(s.a_norm() - g) <= a_tolerance*g : dot(a,a) > 0;
+    s.m_valid = gate_m ? s.m_norm() > 0 && abs(s.m_norm() - field) <= m_tolerance*field : dot(m,m) > 0;
+    if(gate_inclination) {
+        T sin_inclination = s.sin_inclination();
+        s.m_valid = s.m_valid && s.a_valid && sin_inclination >= sin_min && sin_inclination <= sin_max;
+    }
+    return s;
+}
+
+/*
+ * Non-owning set of filters fed from one preprocessed stream.
+ */
+template <typename... Filters>
+class Filter_Set;
+template <>
+class Filter_Set<> {
+public:
+    template <typename T>
+    void update_filter(const Preprocessed_Sample<T>&) {}
+};
+template <typename Head, typename... Tail>
+class Filter_Set<Head, Tail...> : private Filter_Set<Tail...> {
+private:
+    Head& head;
+public:
+    Filter_Set(Head& head, Tail&... tail) : Filter_Set<Tail...>{tail...}, head(head) {}
+    template <typename T>
+    void update_filter(const Preprocessed_Sample<T>& s) {head.update_filter(s); Filter_Set<Tail...>::update_filter(s);}
+};
+template <typename... Filters>
+Filter_Set<Filters...> make_filter_set(Filters&... filters)
+{
+    return Filter_Set<Filters...>{filters...};
+}
+#endif // MEASUREMENT_PIPELINE_H
@@ -168,11 +168,11 @@ Quaternion<T> vec_to_quat(const Vec3<T>& u)
 template <typename T>
 class Unit_Quaternion : public Quaternion_Base<T> {
 private:
-    void normalize() {T norm = std::sqrt(this->w*this->w + this->x*this->x + this->y*this->y + this->z*this->z); this->w /= norm; this->x /= norm; this->y /= norm; this->z /= norm;}
+    void normalize() {using std::sqrt; T norm = sqrt(this->w*this->w + this->x*this->x + this->y*this->y + this->z*this->z); this->w /= norm; this->x /= norm; this->y /= norm; this->z /= norm;}
 public:
     Unit_Quaternion() : Quaternion_Base<T>{1,0,0,0} {}
     Unit_Quaternion(const T& w, const T& x, const T& y, const T& z) : Quaternion_Base<T>{w,x,y,z} {normalize();}
-    Unit_Quaternion(const T& angle, const Vec3<T>& axis) : Quaternion_Base<T>{1,0,0,0} {this->w = std::cos(angle/2);this->x = std::sin(angle/2)*axis[0];this->y = std::sin(angle/2)*axis[1];this->z = std::sin(angle/2)*axis[2];}
+    Unit_Quaternion(const T& angle, const Vec3<T>& axis) : Quaternion_Base<T>{1,0,0,0} {using std::cos; using std::sin; this->w = cos(angle/2);this->x = sin(angle/2)*axis[0];this->y = sin(angle/2)*axis[1];this->z = sin(angle/2)*axis[2];}
     Unit_Quaternion(const Quaternion<T>& q) : Quaternion_Base<T>{q} {normalize();}
 
     Unit_Quaternion(const Unit_Quaternion<T>& q) = default;
@@ -184,6 +184,12 @@ public:
     Unit_Quaternion<T>&      conjugate() {this->x*=-1;this->y*=-1;this->z*=-1;return *this;}
     Unit_Quaternion<T>&      operator*=(const Unit_Quaternion<T>& q);
 };
+//Sets components that are already of unit length without renormalizing, for the batch kernels
+template <typename T>
+void assign_unit(Unit_Quaternion<T>& q, const T& w, const T& x, const T& y, const T& z)
+{
+    static_cast<Quaternion_Base<T>&>(q) = Quaternion_Base<T>{w,x,y,z};
+}
 template <typename T>
 std::ostream& operator<<(std::ostream& os, Unit_Quaternion<T> q)
 {
@@ -236,7 +242,29 @@ Unit_Quaternion<T> conjugate(Unit_Quaternion<T> q)
 template <typename T>
 Unit_Quaternion<T> expq(Vec3<T> v)
 {
-    return {std::cos(v.magnitude()),std::sin(v.magnitude())*v/v.magnitude()};
+    using std::cos;
+    using std::sin;
+    T n = v.magnitude();
+    if(n == 0)
+        return {};
+    Vec3<T> u = sin(n)*v/n;
+    return {cos(n),u[0],u[1],u[2]};
+}
+//Inverse of expq for the rotation, the result is taken on the w >= 0 hemisphere
+template <typename T>
+Vec3<T> logq(const Unit_Quaternion<T>& q)
+{
+    using std::atan2;
+    Vec3<T> v = q.imag();
+    T w = q.real();
+    if(w < 0) {
+        v *= -1;
+        w = -w;
+    }
+    T n = v.magnitude();
+    if(n == 0)
+        return {0,0,0};
+    return atan2(n,w)/n*v;
 }
 template <typename T>
 Vec3<T> rotate_vec(const Unit_Quaternion<T>& q, const Vec3<T>& v)
@@ -0,0 +1,291 @@
+#ifndef QUATERNION_CODEC_H
+#define QUATERNION_CODEC_H
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <type_traits>
+#include "quaternion.h"
+#include "fast_math.h"
+
+/*
+ * Compact encodings of unit quaternions for telemetry and logs.
+ *
+ * Smallest_Three<B> drops the component of largest magnitude, flips the sign so that it
+ * is positive (q and -q are the same rotation) and quantizes the other three, which lie
+ * in [-1/sqrt(2), 1/sqrt(2)], to B bits each on a grid that contains 0. The index of the
+ * dropped component takes the top 2 bits. Decoding recovers it from the unit norm.
+ * Worst case rotation angle between input and decoded quaternion: each kept component is
+ * off by at most half a step, 1/(2*sqrt(2)*half), and the recomputed largest one, which
+ * is at least 1/2, moves by up to sqrt(3) times their combined error. Both add up when
+ * all four components are near 1/2, to an angle of sqrt(6)/half to first order:
+ *  Quat_Code32   2 + 3*10 bits in a uint32_t               4.8e-3 rad
+ *  Quat_Code48   2 + 3*15 bits in the low 48 of a uint64_t 1.5e-4 rad
+ *  Quat_Code64   2 + 3*20 bits in a uint64_t               4.7e-6 rad, 5.4e-6 in float
+ * The float figure includes the rounding of the decoder arithmetic, measured.
+ * store/load write and read the code as Smallest_Three<B>::bytes little endian bytes.
+ *
+ * The array overloads are branch free and vectorize like the kernels in euler.h; the
+ * arrays must not overlap. Without SSE4.2 x86 lacks the 64 bit integer compares, there
+ * only the float Quat_Code32 kernels vectorize, the others need -march set accordingly.
+ */
+template <unsigned B>
+struct Smallest_Three {
+    static_assert(B >= 2 && B <= 20, "Smallest_Three<B> needs 2 <= B <= 20");
+    typedef typename std::conditional<(2 + 3*B <= 32), std::uint32_t, std::uint64_t>::type word_type;
+    static const unsigned component_bits = B;
+    static const unsigned bits = 2 + 3*B;
+    static const unsigned bytes = (bits + 7)/8;
+    //Codes 0 .. 2*half, half is the code of 0
+    static const std::uint32_t half = (1u << (B - 1)) - 1;
+    static const std::uint32_t mask = (1u << B) - 1;
+
+    template <typename T>
+    static void encode(const T* ATT_RESTRICT qw, const T* ATT_RESTRICT qx, const T* ATT_RESTRICT qy, const T* ATT_RESTRICT qz,
+                       word_type* ATT_RESTRICT c, std::size_t n);
+    template <typename T>
+    static void decode(const word_type* ATT_RESTRICT c,
+                       T* ATT_RESTRICT qw, T* ATT_RESTRICT qx, T* ATT_RESTRICT qy, T* ATT_RESTRICT qz, std::size_t n);
+    template <typename T>
+    static void encode(const Unit_Quaternion<T>* q, word_type* c, std::size_t n);
+    template <typename T>
+    static void decode(const word_type* c, Unit_Quaternion<T>* q, std::size_t n);
+    template <typename T>
+    static word_type encode(const Unit_Quaternion<T>& q)    {word_type c; encode(&q, &c, 1); return c;}
+    template <typename T>
+    static Unit_Quaternion<T> decode(word_type c)           {Unit_Quaternion<T> q; decode(&c, &q, 1); return q;}
+
+    static void store(word_type c, std::uint8_t* p)         {for(unsigned i = 0; i < bytes; ++i) p[i] = static_cast<std::uint8_t>(c >> (8*i));}
+    static word_type load(const std::uint8_t* p)            {word_type c = 0; for(unsigned i = 0; i < bytes; ++i) c |= static_cast<word_type>(p[i]) << (8*i); return c;}
+};
+using Quat_Code32 = Smallest_Three<10>;
+using Quat_Code48 = Smallest_Three<15>;
+using Quat_Code64 = Smallest_Three<20>;
+
+template <unsigned B>
+template <typename T>
+void Smallest_Three<B>::encode(const T* ATT_RESTRICT qw, const T* ATT_RESTRICT qx, const T* ATT_RESTRICT qy, const T* ATT_RESTRICT qz,
+                               word_type* ATT_RESTRICT c, std::size_t n)
+{
+    using std::abs;
+    //sqrt(2)*half maps [-1/sqrt(2), 1/sqrt(2)] onto [-half, half]
+    const T scale = static_cast<T>(1.41421356237309504880*half);
+    const T lo = static_cast<T>(0.5);
+    const T hi = static_cast<T>(2*half + 0.5);
+    for(std::size_t k = 0; k < n; ++k) {
+        T w = qw[k], x = qx[k], y = qy[k], z = qz[k];
+        T aw = abs(w), ax = abs(x), ay = abs(y), az = abs(z);
+        //Largest component l at index i, the remaining three in order in a, b, d.
+        //Each step only selects between values of the same width, so that it vectorizes
+        std::int32_t i = 0;
+        T m = aw, l = w;
+        T a = x, b = y, d = z;
+        bool gx = ax > m; i = gx ? 1 : i; l = gx ? x : l; m = gx ? ax : m; a = gx ? w : a;
+        bool gy = ay > m; i = gy ? 2 : i; l = gy ? y : l; m = gy ? ay : m; a = gy ? w : a; b = gy ? x : b;
+        bool gz = az > m; i = gz ? 3 : i; l = gz ? z : l;                   a = gz ? w : a; b = gz ? x : b; d = gz ? y : d;
+        T s = l < 0 ? -scale : scale;
+        //+half + 0.5 and truncation rounds to nearest, the clamp guards against inputs of norm slightly above 1
+        word_type ua = static_cast<word_type>(static_cast<std::int32_t>(std::min(std::max(s*a + (half + lo), lo), hi)));
+        word_type ub = static_cast<word_type>(static_cast<std::int32_t>(std::min(std::max(s*b + (half + lo), lo), hi)));
+        word_type ud = static_cast<word_type>(static_cast<std::int32_t>(std::min(std::max(s*d + (half + lo), lo), hi)));
+        c[k] = (static_cast<word_type>(i) << (3*B)) | (ua << (2*B)) | (ub << B) | ud;
+    }
+}
+template <unsigned B>
+template <typename T>
+void Smallest_Three<B>::decode(const word_type* ATT_RESTRICT c,
+                               T* ATT_RESTRICT qw, T* ATT_RESTRICT qx, T* ATT_RESTRICT qy, T* ATT_RESTRICT qz, std::size_t n)
+{
+    using std::sqrt;
+    const T inv_scale = static_cast<T>(0.70710678118654752440/half);
+    for(std::size_t k = 0; k < n; ++k) {
+        word_type ck = c[k];
+        word_type i = (ck >> (3*B)) & 3;
+        T a = (static_cast<T>(static_cast<std::int32_t>((ck >> (2*B)) & mask)) - static_cast<T>(half))*inv_scale;
+        T b = (static_cast<T>(static_cast<std::int32_t>((ck >> B) & mask)) - static_cast<T>(half))*inv_scale;
+        T d = (static_cast<T>(static_cast<std::int32_t>(ck & mask)) - static_cast<T>(half))*inv_scale;
+        T l = sqrt(std::max(1 - a*a - b*b - d*d, static_cast<T>(0)));
+        qw[k] = i == 0 ? l : a;
+        qx[k] = i == 0 ? a : (i == 1 ? l : b);
+        qy[k] = i <= 1 ? b : (i == 2 ? l : d);
+        qz[k] = i == 3 ? l : d;
+    }
+}
+template <unsigned B>
+template <typename T>
+void Smallest_Three<B>::encode(const Unit_Quaternion<T>* q, word_type* c, std::size_t n)
+{
+    T w[batch_block], x[batch_block], y[batch_block], z[batch_block];
+    for(std::size_t i = 0; i < n; i += batch_block) {
+        std::size_t m = std::min(batch_block, n - i);
+        for(std::size_t k = 0; k < m; ++k) {
+            w[k] = q[i + k][0]; x[k] = q[i + k][1]; y[k] = q[i + k][2]; z[k] = q[i + k][3];
+        }
+        encode(w, x, y, z, c + i, m);
+    }
+}
+template <unsigned B>
+template <typename T>
+void Smallest_Three<B>::decode(const word_type* c, Unit_Quaternion<T>* q, std::size_t n)
+{
+    T w[batch_block], x[batch_block], y[batch_block], z[batch_block];
+    for(std::size_t i = 0; i < n; i += batch_block) {
+        std::size_t m = std::min(batch_block, n - i);
+        decode(c + i, w, x, y, z, m);
+        for(std::size_t k = 0; k < m; ++k)
+            assign_unit(q[i + k], w[k], x[k], y[k], z[k]);
+    }
+}
+
+/*
+ * Delta encoding of a slowly varying attitude stream into 32 bit words.
+ *
+ * A delta word (bit 31 clear) holds the vector part of the rotation from the previously
+ * decoded attitude to the current one, 3 x 10 bit two's complement in units of
+ * 2^-range_shift/511. The encoder tracks the decoded attitude, not the input, so the
+ * quantization error does not accumulate.
+ * When a component does not fit, every key_interval samples if that is non zero, and at
+ * the start, a key frame of two words is emitted instead: bit 31 set, range_shift in bits
+ * 16-20 and the top 15 bits of a Quat_Code48 in bits 0-14, then the low 32 bits of it.
+ * The stream is self describing, the decoder takes range_shift from the key frames.
+ *
+ * With the default range_shift of 6 a delta covers rotations of up to 1.8 deg per axis
+ * and sample. Deltas are accurate to 5.3e-5 rad, 80x better than Quat_Code32 in the same
+ * size; key frames carry the error of Quat_Code48, which the next delta removes.
+ * Encoder and decoder run the same arithmetic. A decoder built with different floating
+ * point contraction can drift from the encoder by rounding until the next key frame.
+ */
+const std::uint32_t delta_key_flag = 0x80000000u;
+
+template <typename T>
+class Delta_Stream_Base {
+protected:
+    Unit_Quaternion<T> ref;
+    unsigned range_shift;
+
+    Delta_Stream_Base(unsigned range_shift) : ref{}, range_shift{range_shift} {}
+    T step() const  {using std::ldexp; return ldexp(static_cast<T>(1), -static_cast<int>(range_shift))/511;}
+    //Rotates ref by the quantized delta d, shared by encoder and decoder
+    void apply_delta(std::int32_t d0, std::int32_t d1, std::int32_t d2)
+    {
+        using std::sqrt;
+        T h = step();
+        T x = static_cast<T>(d0)*h, y = static_cast<T>(d1)*h, z = static_cast<T>(d2)*h;
+        T w = sqrt(std::max(1 - x*x - y*y - z*z, static_cast<T>(0)));
+        //Renormalized so that rounding does not accumulate in the norm
+        ref = Unit_Quaternion<T>{Quaternion<T>{ref*Unit_Quaternion<T>{w, x, y, z}}};
+    }
+    void apply_key(std::uint64_t code)
+    {
+        ref = Quat_Code48::decode<T>(code);
+    }
+};
+template <typename T>
+class Delta_Encoder : private Delta_Stream_Base<T> {
+private:
+    unsigned key_interval;
+    unsigned since_key;
+    bool started;
+public:
+    Delta_Encoder(unsigned range_shift = 6, unsigned key_interval = 0) : Delta_Stream_Base<T>{range_shift}, key_interval{key_interval}, since_key{0}, started{false} {assert(range_shift < 32);}
+    //Appends the code of q to out, returns the number of words written, 1 or 2
+    std::size_t                 encode(const Unit_Quaternion<T>& q, std::uint32_t* out);
+    //Encodes n samples, out must hold 2*n words, returns the number of words written
+    std::size_t                 encode(const Unit_Quaternion<T>* q, std::size_t n, std::uint32_t* out);
+    //Attitude a decoder reproduces after the last encode
+    const Unit_Quaternion<T>&   decoded() const     {return this->ref;}
+    //Forces a key frame on the next sample
+    void                        reset()             {started = false;}
+};
+template <typename T>
+std::size_t Delta_Encoder<T>::encode(const Unit_Quaternion<T>& q, std::uint32_t* out)
+{
+    using std::abs;
+    if(started && (key_interval == 0 || since_key + 1 < key_interval)) {
+        //Relative rotation on the w >= 0 hemisphere
+        Unit_Quaternion<T> r = conjugate(this->ref)*q;
+        T s = r[0] < 0 ? static_cast<T>(-1) : static_cast<T>(1);
+        T inv = 1/this->step();
+        T d[3];
+        for(int i = 0; i < 3; ++i)
+            d[i] = s*r[i + 1]*inv;
+        const T lim = static_cast<T>(511.5);
+        if(abs(d[0]) < lim && abs(d[1]) < lim && abs(d[2]) < lim) {
+            using std::lround;
+            std::int32_t d0 = static_cast<std::int32_t>(lround(d[0]));
+            std::int32_t d1 = static_cast<std::int32_t>(lround(d[1]));
+            std::int32_t d2 = static_cast<std::int32_t>(lround(d[2]));
+            out[0] = ((static_cast<std::uint32_t>(d0) & 0x3ff) << 20) | ((static_cast<std::uint32_t>(d1) & 0x3ff) << 10) | (static_cast<std::uint32_t>(d2) & 0x3ff);
+            this->apply_delta(d0, d1, d2);
+            ++since_key;
+            return 1;
+        }
+    }
+    std::uint64_t code = Quat_Code48::encode(q);
+    out[0] = delta_key_flag | (this->range_shift << 16) | static_cast<std::uint32_t>(code >> 32);
+    out[1] = static_cast<std::uint32_t>(code);
+    this->apply_key(code);
+    started = true;
+    since_key = 0;
+    return 2;
+}
+template <typename T>
+std::size_t Delta_Encoder<T>::encode(const Unit_Quaternion<T>* q, std::size_t n, std::uint32_t* out)
+{
+    std::size_t words = 0;
+    for(std::size_t i = 0; i < n; ++i)
+        words += encode(q[i], out + words);
+    return words;
+}
+template <typename T>
+class Delta_Decoder : private Delta_Stream_Base<T> {
+private:
+    bool started;
+public:
+    Delta_Decoder() : Delta_Stream_Base<T>{0}, started{false} {}
+    //Decodes one sample from in, returns the number of words consumed, 1 or 2, or 0 if
+    //n_words is too short or the stream does not start with a key frame
+    std::size_t     decode(const std::uint32_t* in, std::size_t n_words, Unit_Quaternion<T>& q);
+    //Decodes up to n_words words into at most max_samples entries of q, returns the number
+    //of samples. Stops early at a truncated key frame or, at the start, at a delta word
+    std::size_t     decode(const std::uint32_t* in, std::size_t n_words, Unit_Quaternion<T>* q, std::size_t max_samples);
+};
+template <typename T>
+std::size_t Delta_Decoder<T>::decode(const std::uint32_t* in, std::size_t n_words, Unit_Quaternion<T>& q)
+{
+    if(n_words == 0)
+        return 0;
+    std::uint32_t c = in[0];
+    if(c & delta_key_flag) {
+        if(n_words < 2)
+            return 0;
+        this->range_shift = (c >> 16) & 0x1f;
+        this->apply_key((static_cast<std::uint64_t>(c & 0x7fff) << 32) | in[1]);
+        started = true;
+        q = this->ref;
+        return 2;
+    }
+    if(!started)
+        return 0;
+    //Sign extend the 10 bit fields
+    std::int32_t d0 = static_cast<std::int32_t>(c << 2) >> 22;
+    std::int32_t d1 = static_cast<std::int32_t>(c << 12) >> 22;
+    std::int32_t d2 = static_cast<std::int32_t>(c << 22) >> 22;
+    this->apply_delta(d0, d1, d2);
+    q = this->ref;
+    return 1;
+}
+template <typename T>
+std::size_t Delta_Decoder<T>::decode(const std::uint32_t* in, std::size_t n_words, Unit_Quaternion<T>* q, std::size_t max_samples)
+{
+    std::size_t n = 0;
+    std::size_t used;
+    while(n < max_samples && (used = decode(in, n_words, q[n])) != 0) {
+        in += used;
+        n_words -= used;
+        ++n;
+    }
+    return n;
+}
+#endif // QUATERNION_CODEC_H
@@ -19,7 +19,7 @@ public:
     Vec3<T>&    operator-=(const Vec3<T>& v)            {x -= v.x; y -= v.y; z -= v.z; return *this;}
     Vec3<T>&    operator*=(const T& a)                  {x *= a; y *= a; z *= a; return *this;}
     Vec3<T>&    operator/=(const T& a)                  {x /= a; y /= a; z /= a; return *this;}
-    T magnitude() {return std::sqrt(x*x + y*y + z*z);}
+    T magnitude() {using std::sqrt; return sqrt(x*x + y*y + z*z);}
 };
 template <typename T>
 T Vec3<T>::operator[](const unsigned int i) const
@@ -92,6 +92,11 @@ std::ostream& operator<<(std::ostream& os, const Vec3<T>& v)
     return os << "Vector<3>: " << "{" << v[0] << ", " << v[1] << ", " << v[2] << "}";
 }
 template <typename T>
+Vec3<T> operator*(const Mat3<T>& M, const Vec3<T>& v)
+{
+    return {M(0,0)*v[0] + M(0,1)*v[1] + M(0,2)*v[2], M(1,0)*v[0] + M(1,1)*v[1] + M(1,2)*v[2], M(2,0)*v[0] + M(2,1)*v[1] + M(2,2)*v[2]};
+}
+template <typename T>
 Mat3<T> outer(Vec3<T> u, Vec3<T> v)
 {
     return {{u[0]*v[0],u[0]*v[1],u[0]*v[2]},{u[1]*v[0],u[1]*v[1],u[1]*v[2]},{u[2]*v[0],u[2]*v[1],u[2]*v[2]}};
@@ -0,0 +1,107 @@
+#include <iostream>
+#include <cmath>
+#include <random>
+#include "../inc/vec3.h"
+#include "../inc/mat3.h"
+#include "../inc/calibration.h"
+
+/*
+ * From noise free synthetic data the magnetometer fit recovers a known hard iron offset and
+ * symmetric soft iron distortion, and the gyro fit a known per axis scale and bias.
+ * solve() fails on too few samples and on samples in a plane, and keeps the identity.
+ */
+
+using namespace std;
+
+static int failures = 0;
+
+void check(const string& name, double e, double tolerance)
+{
+    if(!(e <= tolerance)) {
+        cout << name << ": " << e << '\n';
+        ++failures;
+    }
+}
+double max_abs(const Vec3<double>& v)
+{
+    return max(abs(v[0]), max(abs(v[1]), abs(v[2])));
+}
+//Uniformly distributed direction
+Vec3<double> direction(mt19937& generator)
+{
+    normal_distribution<double> normal(0, 1);
+    Vec3<double> v{normal(generator), normal(generator), normal(generator)};
+    return v/sqrt(dot(v,v));
+}
+
+int main()
+{
+    mt19937 generator{5};
+    const double field = 0.5;
+    const Vec3<double> offset{0.2,-0.1,0.3};
+    //Symmetric soft iron distortion m = A h + offset
+    const Mat3<double> A{{1.1,0.05,0.02},{0.05,0.9,-0.03},{0.02,-0.03,1.0}};
+    const double det_A = 1.1*(0.9*1.0 - 0.03*0.03) - 0.05*(0.05*1.0 + 0.03*0.02) + 0.02*(-0.05*0.03 - 0.9*0.02);
+
+    Magnetometer_Calibrator<double> mag;
+    for(int k = 0; k < 500; ++k)
+        mag.add_sample(A*(field*direction(generator)) + offset);
+    check("ellipsoid solves", !mag.solve(), 0);
+    check("hard iron offset", max_abs(mag.get_offset() - offset), 1e-9);
+    //W undoes A up to the geometric mean radius, W A = det(A)^(1/3) I
+    const Mat3<double> W = mag.get_soft_iron();
+    const Vec3<double> e[3] = {{1,0,0},{0,1,0},{0,0,1}};
+    for(int j = 0; j < 3; ++j)
+        check("soft iron column " + to_string(j), max_abs(W*(A*e[j]) - cbrt(det_A)*e[j]), 1e-9);
+    Vec3<double> h = field*direction(generator);
+    Vec3<double> u = mag.correct(A*h + offset);
+    check("corrected vector", max_abs(u - cbrt(det_A)*h), 1e-9);
+
+    //A sphere around the offset, the hard iron fit needs no soft iron
+    Magnetometer_Calibrator<double> sphere;
+    for(int k = 0; k < 100; ++k)
+        sphere.add_sample(field*direction(generator) + offset);
+    check("sphere solves", !sphere.solve_hard_iron(), 0);
+    check("sphere offset", max_abs(sphere.get_offset() - offset), 1e-9);
+
+    //9 unknowns need 9 samples
+    Magnetometer_Calibrator<double> few;
+    for(int k = 0; k < 8; ++k)
+        few.add_sample(A*(field*direction(generator)) + offset);
+    check("too few samples fail", few.solve(), 0);
+    check("identity kept", max_abs(few.correct(offset) - offset), 0);
+    //A turn about the vertical only: a circle in a plane of constant z
+    Magnetometer_Calibrator<double> planar;
+    for(int k = 0; k < 100; ++k) {
+        double angle = 2*M_PI*k/100;
+        planar.add_sample(Vec3<double>{0.4*cos(angle), 0.4*sin(angle), -0.3} + offset);
+    }
+    check("planar samples fail", planar.solve(), 0);
+    check("identity kept", max_abs(planar.correct(offset) - offset), 0);
+
+    //w = s*w_ref + b per axis, stationary samples included
+    const Vec3<double> scale{1.02,0.97,1.05}, bias{0.01,-0.02,0.005};
+    uniform_real_distribution<double> rate(-2, 2);
+    Gyro_Calibrator<double> gyro;
+    for(int k = 0; k < 200; ++k) {
+        Vec3<double> w_ref = k % 4 ? Vec3<double>{rate(generator), rate(generator), rate(generator)} : Vec3<double>{0,0,0};
+        gyro.add_sample(Vec3<double>{scale[0]*w_ref[0], scale[1]*w_ref[1], scale[2]*w_ref[2]} + bias, w_ref);
+    }
+    check("gyro solves", !gyro.solve(), 0);
+    check("gyro scale", max_abs(gyro.get_scale() - scale), 1e-12);
+    check("gyro bias", max_abs(gyro.get_bias() - bias), 1e-12);
+    Vec3<double> w_ref{0.3,-1.2,0.7};
+    check("gyro corrected", max_abs(gyro.correct(Vec3<double>{scale[0]*w_ref[0], scale[1]*w_ref[1], scale[2]*w_ref[2]} + bias) - w_ref), 1e-12);
+
+    Gyro_Calibrator<double> empty;
+    check("no samples fail", empty.solve(), 0);
+    //At rest the scale is not observable, it is kept and only the bias updates
+    Gyro_Calibrator<double> rest;
+    for(int k = 0; k < 10; ++k)
+        rest.add_stationary(bias);
+    check("stationary samples solve", !rest.solve(), 0);
+    check("stationary scale kept", max_abs(rest.get_scale() - Vec3<double>{1,1,1}), 0);
+    check("stationary bias", max_abs(rest.get_bias() - bias), 1e-15);
+
+    return failures ? 1 : 0;
+}
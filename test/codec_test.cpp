@@ -0,0 +1,144 @@
+#include <iostream>
+#include <cmath>
+#include <random>
+#include <vector>
+#include "../inc/quaternion.h"
+#include "../inc/quaternion_codec.h"
+
+/*
+ * Smallest_Three round trips within the documented worst case, including equal
+ * components and sign flips, and Delta_Decoder respects its output capacity and rejects
+ * truncated streams and streams that do not start with a key frame.
+ */
+
+using namespace std;
+
+static int failures = 0;
+
+void check(const string& name, double e, double tolerance)
+{
+    if(!(e <= tolerance)) {
+        cout << name << ": " << e << '\n';
+        ++failures;
+    }
+}
+template <typename T>
+double rotation_angle(const Unit_Quaternion<T>& p, const Unit_Quaternion<T>& q)
+{
+    double d = 0;
+    for(int i = 0; i < 4; ++i)
+        d += static_cast<double>(p[i])*q[i];
+    //2*|vector part of conjugate(p)*q|, well conditioned for small angles
+    double x = p[0]*static_cast<double>(q[1]) - static_cast<double>(q[0])*p[1] - (static_cast<double>(p[2])*q[3] - static_cast<double>(p[3])*q[2]);
+    double y = p[0]*static_cast<double>(q[2]) - static_cast<double>(q[0])*p[2] - (static_cast<double>(p[3])*q[1] - static_cast<double>(p[1])*q[3]);
+    double z = p[0]*static_cast<double>(q[3]) - static_cast<double>(q[0])*p[3] - (static_cast<double>(p[1])*q[2] - static_cast<double>(p[2])*q[1]);
+    return 2*atan2(sqrt(x*x + y*y + z*z), abs(d));
+}
+template <typename Code, typename T>
+void round_trip(const string& name, double bound)
+{
+    mt19937 generator{9};
+    normal_distribution<double> normal;
+    uniform_real_distribution<double> unit(-1, 1);
+    vector<Unit_Quaternion<T>> q;
+    for(int k = 0; k < 200000; ++k) {
+        double c[4];
+        if(k % 2) {
+            //Components near 1/2 with every sign, the worst case
+            for(int i = 0; i < 4; ++i)
+                c[i] = (k >> (i + 1) & 1 ? -1 : 1)*(0.5 + 3e-4*unit(generator));
+        } else {
+            for(int i = 0; i < 4; ++i)
+                c[i] = normal(generator);
+        }
+        double n = sqrt(c[0]*c[0] + c[1]*c[1] + c[2]*c[2] + c[3]*c[3]);
+        Unit_Quaternion<T> p;
+        assign_unit(p, static_cast<T>(c[0]/n), static_cast<T>(c[1]/n), static_cast<T>(c[2]/n), static_cast<T>(c[3]/n));
+        q.push_back(p);
+    }
+    //Exactly equal components and the axes, with both signs
+    for(int s = 0; s < 16; ++s) {
+        Unit_Quaternion<T> p;
+        assign_unit(p, static_cast<T>(s & 1 ? -0.5 : 0.5), static_cast<T>(s & 2 ? -0.5 : 0.5),
+                       static_cast<T>(s & 4 ? -0.5 : 0.5), static_cast<T>(s & 8 ? -0.5 : 0.5));
+        q.push_back(p);
+    }
+    for(int i = 0; i < 8; ++i) {
+        T c[4] = {0, 0, 0, 0};
+        c[i % 4] = i < 4 ? 1 : -1;
+        Unit_Quaternion<T> p;
+        assign_unit(p, c[0], c[1], c[2], c[3]);
+        q.push_back(p);
+    }
+    const size_t n = q.size();
+    vector<typename Code::word_type> c(n), c_neg(n);
+    vector<Unit_Quaternion<T>> q_neg(n), q_out(n);
+    for(size_t k = 0; k < n; ++k)
+        assign_unit(q_neg[k], -q[k][0], -q[k][1], -q[k][2], -q[k][3]);
+    Code::encode(q.data(), c.data(), n);
+    Code::encode(q_neg.data(), c_neg.data(), n);
+    Code::decode(c.data(), q_out.data(), n);
+    double e = 0;
+    size_t sign_mismatch = 0, store_mismatch = 0;
+    uint8_t bytes[8];
+    for(size_t k = 0; k < n; ++k) {
+        e = max(e, rotation_angle(q[k], q_out[k]));
+        sign_mismatch += c[k] != c_neg[k];
+        Code::store(c[k], bytes);
+        store_mismatch += Code::load(bytes) != c[k];
+    }
+    check(name + " worst case angle", e, bound);
+    check(name + " q and -q encode alike", sign_mismatch, 0);
+    check(name + " store/load", store_mismatch, 0);
+}
+
+int main()
+{
+    //sqrt(6)/half, plus the float rounding for Quat_Code64
+    round_trip<Quat_Code32, double>("Quat_Code32 double", 4.8e-3);
+    round_trip<Quat_Code32, float>("Quat_Code32 float", 4.8e-3);
+    round_trip<Quat_Code48, double>("Quat_Code48 double", 1.5e-4);
+    round_trip<Quat_Code48, float>("Quat_Code48 float", 1.5e-4);
+    round_trip<Quat_Code64, double>("Quat_Code64 double", 4.7e-6);
+    round_trip<Quat_Code64, float>("Quat_Code64 float", 5.4e-6);
+
+    //A slowly rotating stream with a key frame every 50 samples
+    const size_t n = 200;
+    vector<Unit_Quaternion<double>> q(n);
+    for(size_t k = 0; k < n; ++k) {
+        double h = 0.005*k;
+        q[k] = Unit_Quaternion<double>{cos(h), sin(h)*0.6, 0, sin(h)*0.8};
+    }
+    Delta_Encoder<double> enc{6, 50};
+    vector<uint32_t> words(2*n);
+    size_t n_words = enc.encode(q.data(), n, words.data());
+    check("key frame first", !(words[0] & delta_key_flag), 0);
+
+    vector<Unit_Quaternion<double>> out(n + 1);
+    Delta_Decoder<double> full;
+    check("whole stream", static_cast<double>(n) - full.decode(words.data(), n_words, out.data(), n), 0);
+
+    //Capacity: nothing is written past max_samples
+    const Unit_Quaternion<double> sentinel{0, 1, 0, 0};
+    out.assign(n + 1, sentinel);
+    Delta_Decoder<double> capped;
+    size_t got = capped.decode(words.data(), n_words, out.data(), 10);
+    check("max_samples", static_cast<double>(got) - 10, 0);
+    check("nothing past max_samples", out[10][1] != 1, 0);
+
+    //Truncated inside the first key frame: no sample
+    Delta_Decoder<double> truncated_key;
+    check("truncated key frame", static_cast<double>(truncated_key.decode(words.data(), 1, out.data(), n)), 0);
+    //Truncated inside a later key frame: the samples before it
+    size_t second_key = 2;
+    while(!(words[second_key] & delta_key_flag))
+        ++second_key;
+    Delta_Decoder<double> truncated;
+    got = truncated.decode(words.data(), second_key + 1, out.data(), n);
+    check("truncated later key frame", static_cast<double>(got) - (second_key - 1), 0);
+    //Starting after the first key frame, on delta words: no sample
+    Delta_Decoder<double> no_key;
+    check("stream without a key frame", static_cast<double>(no_key.decode(words.data() + 2, n_words - 2, out.data(), n)), 0);
+
+    return failures ? 1 : 0;
+}
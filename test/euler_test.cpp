@@ -0,0 +1,101 @@
+#include <iostream>
+#include <cmath>
+#include <random>
+#include <vector>
+#include "../inc/quaternion.h"
+#include "../inc/euler.h"
+
+/*
+ * quat_to_euler reproduces the input rotation at any pitch, including exactly at and
+ * near gimbal lock, and sets roll to 0 in the lock. euler_to_quat inverts it.
+ */
+
+using namespace std;
+
+static int failures = 0;
+
+void check(const string& name, double e, double tolerance)
+{
+    if(!(e <= tolerance)) {
+        cout << name << ": " << e << '\n';
+        ++failures;
+    }
+}
+Unit_Quaternion<double> euler_to_quat_exact(double r, double p, double y)
+{
+    double cr = cos(r/2), sr = sin(r/2), cp = cos(p/2), sp = sin(p/2), cy = cos(y/2), sy = sin(y/2);
+    return {cr*cp*cy + sr*sp*sy, sr*cp*cy - cr*sp*sy, cr*sp*cy + sr*cp*sy, cr*cp*sy - sr*sp*cy};
+}
+double rotation_error(const Unit_Quaternion<double>& p, double w, double x, double y, double z)
+{
+    auto d = conjugate(p)*Unit_Quaternion<double>{w, x, y, z};
+    return 2*atan2(d.imag().magnitude(), abs(d.real()));
+}
+double angle_error(double a, double b)
+{
+    double d = abs(a - b);
+    return min(d, 2*M_PI - d);
+}
+//Max rotation error over samples whose pitch is within [lo, hi] of +-pi/2 (lo = hi = 0: exactly locked)
+template <typename T>
+double near_lock(double lo, double hi, bool& roll_zero)
+{
+    mt19937 generator{5};
+    uniform_real_distribution<double> angle(-M_PI, M_PI), unit(0, 1);
+    double e = 0;
+    roll_zero = true;
+    for(int k = 0; k < 20000; ++k) {
+        double delta = lo > 0 ? lo*pow(hi/lo, unit(generator)) : 0;
+        double p = (k & 1 ? 1 : -1)*(M_PI/2 - delta);
+        auto q = euler_to_quat_exact(angle(generator), p, angle(generator));
+        T w = static_cast<T>(q[0]), x = static_cast<T>(q[1]), y = static_cast<T>(q[2]), z = static_cast<T>(q[3]);
+        T roll, pitch, yaw;
+        quat_to_euler(&w, &x, &y, &z, &roll, &pitch, &yaw, 1);
+        e = max(e, rotation_error(euler_to_quat_exact(roll, pitch, yaw), w, x, y, z));
+        roll_zero = roll_zero && roll == 0;
+    }
+    return e;
+}
+template <typename T>
+void run(const string& name, double rotation_tolerance, double angle_tolerance)
+{
+    bool roll_zero;
+    check(name + " exactly locked", near_lock<T>(0, 0, roll_zero), rotation_tolerance);
+    check(name + " roll 0 when locked", !roll_zero, 0);
+    check(name + " 1e-7..1e-4 from vertical", near_lock<T>(1e-7, 1e-4, roll_zero), rotation_tolerance);
+    check(name + " 1e-4..2e-3 from vertical", near_lock<T>(1e-4, 2e-3, roll_zero), rotation_tolerance);
+    check(name + " 2e-3..0.1 from vertical", near_lock<T>(2e-3, 0.1, roll_zero), rotation_tolerance);
+
+    //Any attitude, and the angles themselves away from the lock
+    mt19937 generator{7};
+    uniform_real_distribution<double> angle(-M_PI, M_PI);
+    const size_t n = 100000;
+    vector<Vec3<double>> E_exact(n);
+    vector<Unit_Quaternion<T>> q(n), q_back(n);
+    vector<Vec3<T>> E(n);
+    for(size_t k = 0; k < n; ++k) {
+        E_exact[k] = {angle(generator), angle(generator)/2, angle(generator)};
+        auto p = euler_to_quat_exact(E_exact[k][0], E_exact[k][1], E_exact[k][2]);
+        assign_unit(q[k], static_cast<T>(p[0]), static_cast<T>(p[1]), static_cast<T>(p[2]), static_cast<T>(p[3]));
+    }
+    quat_to_euler(q.data(), E.data(), n);
+    euler_to_quat(E.data(), q_back.data(), n);
+    double e_rot = 0, e_angle = 0, e_back = 0;
+    for(size_t k = 0; k < n; ++k) {
+        e_rot = max(e_rot, rotation_error(euler_to_quat_exact(E[k][0], E[k][1], E[k][2]), q[k][0], q[k][1], q[k][2], q[k][3]));
+        e_back = max(e_back, rotation_error(euler_to_quat_exact(E[k][0], E[k][1], E[k][2]), q_back[k][0], q_back[k][1], q_back[k][2], q_back[k][3]));
+        if(abs(sin(E_exact[k][1])) < 0.999)
+            for(int i = 0; i < 3; ++i)
+                e_angle = max(e_angle, angle_error(E[k][i], E_exact[k][i]));
+    }
+    check(name + " any attitude", e_rot, rotation_tolerance);
+    check(name + " angles away from the lock", e_angle, angle_tolerance);
+    check(name + " euler_to_quat", e_back, 1e-6);
+}
+
+int main()
+{
+    run<float>("float", 4.5e-6, 5e-6);
+    run<double>("double", 4e-6, 3.5e-6);
+    return failures ? 1 : 0;
+}
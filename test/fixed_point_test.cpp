@@ -0,0 +1,79 @@
+#include <iostream>
+#include <cmath>
+#include <limits>
+#include "../inc/fixed_point.h"
+
+/*
+ * Saturation at the Q-format limits, conversions of non-finite values, and the accuracy
+ * of sqrt and asin in LSB.
+ */
+
+using namespace std;
+
+static int failures = 0;
+
+void check(const string& name, bool ok)
+{
+    if(!ok) {
+        cout << name << '\n';
+        ++failures;
+    }
+}
+//Error in units of the last place
+template <int F>
+double lsb_error(const Fixed<F>& a, double ref)
+{
+    return abs(static_cast<double>(a) - ref)*(static_cast<double>(1 << F));
+}
+
+int main()
+{
+    //Conversions
+    check("NaN converts to 0", Q16_16{numeric_limits<double>::quiet_NaN()}.raw() == 0);
+    check("+inf saturates", Q16_16{numeric_limits<double>::infinity()} == Q16_16::max());
+    check("-inf saturates", Q16_16{-numeric_limits<double>::infinity()} == Q16_16::min());
+    check("1e30 saturates", Q16_16{1e30} == Q16_16::max());
+    check("-1e30f saturates", Q16_16{-1e30f} == Q16_16::min());
+    check("32768 saturates in Q16.16", Q16_16{32768.0} == Q16_16::max());
+    check("-32768 is exact in Q16.16", Q16_16{-32768.0} == Q16_16::min());
+    check("int saturates", Q8_24{1000} == Q8_24::max());
+    check("round trip", static_cast<double>(Q16_16{-1.25}) == -1.25);
+
+    //Saturating arithmetic
+    check("max + eps", Q16_16::max() + Q16_16::epsilon() == Q16_16::max());
+    check("min - eps", Q16_16::min() - Q16_16::epsilon() == Q16_16::min());
+    check("-min", -Q16_16::min() == Q16_16::max());
+    check("overflowing product", Q16_16{300}*Q16_16{300} == Q16_16::max());
+    check("overflowing negative product", Q16_16{-300}*Q16_16{300} == Q16_16::min());
+    check("overflowing quotient", Q16_16{1000}/Q16_16{0.001} == Q16_16::max());
+    check("division by zero", Q16_16{-3}/Q16_16{0} == Q16_16::min() && Q16_16{3}/Q16_16{0} == Q16_16::max()
+                              && Q16_16{0}/Q16_16{0} == Q16_16{0});
+    check("rounded product", Q16_16::epsilon()*Q16_16{0.5} == Q16_16::epsilon());
+
+    //sqrt <= 1 LSB, asin <= 2 LSB for |x| <= 0.9 and <= 3 LSB for |x| < 0.99
+    double e_sqrt = 0, e_asin = 0, e_asin_wide = 0;
+    for(int k = 0; k <= 100000; ++k) {
+        double x = 30000.0*k/100000;
+        Q16_16 a{x};
+        e_sqrt = max(e_sqrt, lsb_error(sqrt(a), sqrt(static_cast<double>(a))));
+        Q8_24 b{x/30000*8};
+        e_sqrt = max(e_sqrt, lsb_error(sqrt(b), sqrt(static_cast<double>(b))));
+        double y = -0.99 + 1.98*k/100000;
+        Q16_16 c{y};
+        Q8_24 d{y};
+        double e = max(lsb_error(asin(c), asin(static_cast<double>(c))), lsb_error(asin(d), asin(static_cast<double>(d))));
+        if(abs(y) <= 0.9)
+            e_asin = max(e_asin, e);
+        else
+            e_asin_wide = max(e_asin_wide, e);
+    }
+    check("sqrt within 1 LSB", e_sqrt <= 1);
+    check("asin within 2 LSB for |x| <= 0.9", e_asin <= 2);
+    check("asin within 3 LSB for |x| < 0.99", e_asin_wide <= 3);
+    check("sqrt of a negative", sqrt(Q16_16{-4}) == Q16_16{0});
+    check("asin clamps", asin(Q16_16{1.5}) == asin(Q16_16{1}));
+    if(failures)
+        cout << "sqrt " << e_sqrt << " LSB, asin " << e_asin << " and " << e_asin_wide << " LSB\n";
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,57 @@
+#include <iostream>
+#include <cmath>
+#include <vector>
+#include "../inc/quaternion.h"
+#include "../inc/interpolation.h"
+
+/*
+ * resample on a float track with double timestamps around 1e4 s: the interpolation
+ * parameter is resolved in double, the result matches slerp in double.
+ */
+
+using namespace std;
+
+int main()
+{
+    const size_t n_src = 1000;
+    const double t0 = 1e4;
+    vector<double> t_src(n_src);
+    vector<Unit_Quaternion<float>> q_src(n_src);
+    vector<Unit_Quaternion<double>> q_exact(n_src);
+    for(size_t k = 0; k < n_src; ++k) {
+        double t = k*0.01;
+        t_src[k] = t0 + t;
+        //Rotation about a tilted axis at 1 rad/s
+        double h = t/2, s = sin(h)/sqrt(1.25);
+        q_exact[k] = Unit_Quaternion<double>{cos(h), s, 0.5*s, 0};
+        q_src[k] = Unit_Quaternion<float>{static_cast<float>(q_exact[k][0]), static_cast<float>(q_exact[k][1]),
+                                          static_cast<float>(q_exact[k][2]), static_cast<float>(q_exact[k][3])};
+    }
+    //1 kHz queries, off the sample grid
+    const size_t n_query = 9000;
+    vector<double> t_query(n_query);
+    for(size_t k = 0; k < n_query; ++k)
+        t_query[k] = t0 + 0.0003 + k*0.001;
+    vector<Unit_Quaternion<float>> q_out(n_query);
+    resample(t_src.data(), q_src.data(), n_src, t_query.data(), q_out.data(), n_query);
+
+    double e_max = 0;
+    for(size_t k = 0; k < n_query; ++k) {
+        //Exact parameter from the time relative to t0
+        double t = 0.0003 + k*0.001;
+        size_t j = static_cast<size_t>(t/0.01);
+        double u = (t - j*0.01)/0.01;
+        Unit_Quaternion<double> r = slerp(q_exact[j], q_exact[j + 1], u);
+        //2|vector part of conjugate(r)*q|, well conditioned for small angles unlike acos
+        double q0 = q_out[k][0], q1 = q_out[k][1], q2 = q_out[k][2], q3 = q_out[k][3];
+        double x = r[0]*q1 - q0*r[1] - (r[2]*q3 - r[3]*q2);
+        double y = r[0]*q2 - q0*r[2] - (r[3]*q1 - r[1]*q3);
+        double z = r[0]*q3 - q0*r[3] - (r[1]*q2 - r[2]*q1);
+        e_max = max(e_max, 2*sqrt(x*x + y*y + z*z));
+    }
+    if(!(e_max < 1e-5)) {
+        cout << "resample: max error " << e_max << " rad\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,86 @@
+#include <iostream>
+#include <cmath>
+#include <random>
+#include "../inc/quaternion.h"
+#include "../inc/vec3.h"
+#include "../inc/explicit_complementary_filter.h"
+#include "../inc/madgwick.h"
+#include "../inc/measurement_pipeline.h"
+#include "../inc/update_schedule.h"
+
+/*
+ * Without gates the preprocessed path matches the direct update_filter(), and samples
+ * with all observations rejected count toward max_interval.
+ */
+
+using namespace std;
+
+static int failures = 0;
+
+void check(const string& name, double e, double tolerance)
+{
+    if(!(e <= tolerance)) {
+        cout << name << ": " << e << '\n';
+        ++failures;
+    }
+}
+template <typename Filter>
+double difference(Filter& F, Filter& G)
+{
+    Unit_Quaternion<double> p = F.get_attitude(), q = G.get_attitude();
+    Vec3<double> b = F.get_bias() - G.get_bias();
+    double e = 0;
+    for(int i = 0; i < 4; ++i)
+        e = max(e, abs(p[i] - q[i]));
+    return max(e, max(abs(b[0]), max(abs(b[1]), abs(b[2]))));
+}
+
+int main()
+{
+    const double dt = 0.01;
+    mt19937 generator{3};
+    normal_distribution<double> noise(0, 0.05);
+    Measurement_Preprocessor<double> pre;
+
+    //Unnormalized references and observations, the gains scale with their magnitudes
+    ECF<double,2> E_direct, E_pipeline;
+    Madgwick<double> M_direct, M_pipeline;
+    for(auto* F : {&E_direct, &E_pipeline}) {
+        F->set_gains(2.5, 0.2, 0.5, 0.5);
+        F->set_reference_vectors(Vec3<double>{0,0,9.81}, Vec3<double>{30,0,-40});
+    }
+    for(auto* F : {&M_direct, &M_pipeline})
+        F->set_gains(2.0, 1.0, 0.2);
+    for(int k = 0; k < 1000; ++k) {
+        Vec3<double> w{0.3 + noise(generator), -0.2 + noise(generator), 0.1 + noise(generator)};
+        Vec3<double> a{noise(generator), 0.5 + noise(generator), 9.81 + noise(generator)};
+        Vec3<double> m{30 + noise(generator), 2 + noise(generator), -40 + noise(generator)};
+        E_direct.update_filter(w, dt, a, m);
+        M_direct.update_filter(w, dt, a, m);
+        Preprocessed_Sample<double> s = pre.process(w, dt, a, m);
+        make_filter_set(E_pipeline, M_pipeline).update_filter(s);
+    }
+    check("ECF direct vs pipeline", difference(E_direct, E_pipeline), 0);
+    check("Madgwick direct vs pipeline", difference(M_direct, M_pipeline), 1e-9);
+
+    //Zero vectors are rejected without gates, the normalized vectors are shared
+    Preprocessed_Sample<double> z = pre.process(Vec3<double>{0,0,0}, dt, Vec3<double>{0,0,0}, Vec3<double>{3,0,-4});
+    check("zero vector rejected", z.a_valid, 0);
+    check("nonzero vector accepted", !z.m_valid, 0);
+    check("m_norm", abs(z.m_norm() - 5), 1e-15);
+    check("m_hat", abs(z.m_hat()[0] - 0.6) + abs(z.m_hat()[2] + 0.8), 1e-15);
+    check("a_hat of a zero vector", dot(z.a_hat(), z.a_hat()), 0);
+
+    //A settled schedule may skip, but not once rejected samples have used up max_interval
+    Update_Schedule<double> schedule;
+    schedule.configure(0.1, 0.05, 4, 0.05);
+    schedule.skip({0,0,0}, dt);
+    schedule.corrected(0);
+    for(int k = 0; k < 5; ++k)
+        schedule.gated(dt);
+    check("skip after rejected samples", schedule.skip({0,0,0}, dt), 0);
+    schedule.corrected(0);
+    check("skip when settled", !schedule.skip({0,0,0}, dt), 0);
+
+    return failures ? 1 : 0;
+}
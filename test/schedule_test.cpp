@@ -0,0 +1,179 @@
+#include <iostream>
+#include <cmath>
+#include <random>
+#include "../inc/quaternion.h"
+#include "../inc/vec3.h"
+#include "../inc/explicit_complementary_filter.h"
+#include "../inc/madgwick.h"
+
+/*
+ * reset_filter() forgets the corrections skipped before it: skip, reset, step must match
+ * a fresh filter. Madgwick skips while settled and quiet, within max_skip and max_interval,
+ * and its resumed correction moves about as far as the consecutive ones would have,
+ * without stepping past the minimum. With noise at rest it is as accurate as correcting
+ * every sample. One innovation threshold means the same attitude error for ECF and Madgwick.
+ */
+
+using namespace std;
+
+static int failures = 0;
+
+void check(const string& name, double e, double tolerance)
+{
+    if(!(e <= tolerance)) {
+        cout << name << ": " << e << '\n';
+        ++failures;
+    }
+}
+template <typename Filter>
+void check_same(const string& name, Filter& F, Filter& G)
+{
+    Unit_Quaternion<double> p = F.get_attitude(), q = G.get_attitude();
+    Vec3<double> b = F.get_bias() - G.get_bias();
+    double e = 0;
+    for(int i = 0; i < 4; ++i)
+        e = max(e, abs(p[i] - q[i]));
+    e = max(e, max(abs(b[0]), max(abs(b[1]), abs(b[2]))));
+    if(!(e < 1e-12)) {
+        cout << name << ": differs from a fresh filter by " << e << '\n';
+        ++failures;
+    }
+}
+double angle_between(const Unit_Quaternion<double>& p, const Unit_Quaternion<double>& q)
+{
+    auto d = conjugate(p)*q;
+    return 2*atan2(d.imag().magnitude(), abs(d.real()));
+}
+
+static const double dt = 0.01;
+static const Vec3<double> up{0,0,1}, field{0.6,0,-0.8};
+
+//Noise free observations of a body at rest at attitude q, rotated by angle from identity
+struct Scene {
+    Unit_Quaternion<double> q;
+    Vec3<double> a;
+    Vec3<double> m;
+    explicit Scene(double angle) : q{angle, Vec3<double>{1,1,0}/sqrt(2.0)},
+        a{rotate_vec(conjugate(q), up)}, m{rotate_vec(conjugate(q), field)} {}
+};
+//Skipped corrections of a Madgwick filter set up with the schedule, after n samples
+unsigned long madgwick_skips(const Scene& s, const Vec3<double>& w, double innovation, unsigned int max_skip, double max_interval, int n)
+{
+    Madgwick<double,Counting_Instrumentation> M;
+    M.set_gains(2.0, 1.0, 0.2);
+    M.set_schedule(0.1, innovation, max_skip, max_interval);
+    for(int k = 0; k < n; ++k)
+        M.update_filter(w, dt, s.a, s.m);
+    return M.get_instrumentation().skipped;
+}
+unsigned long ecf_skips(const Scene& s, double innovation, int n)
+{
+    ECF<double,2,Counting_Instrumentation> E;
+    E.set_gains(1.0, 0.3, 1.0, 1.0);
+    E.set_reference_vectors(up, field);
+    E.set_schedule(0.1, innovation, 4, 1);
+    for(int k = 0; k < n; ++k)
+        E.update_filter(Vec3<double>{0,0,0}, dt, s.a, s.m);
+    return E.get_instrumentation().skipped;
+}
+//rms attitude error over the last quarter of a noisy minute at rest
+double madgwick_rms_at_rest(bool scheduled)
+{
+    mt19937 generator{1};
+    normal_distribution<double> gyro_noise(0, 0.01), obs_noise(0, 0.02);
+    const Scene s{0.2};
+    const Vec3<double> bias{0.1,0.1,0.1};
+    Madgwick<double> M;
+    M.set_gains(2.0, 1.0, 0.2);
+    if(scheduled)
+        M.set_schedule(0.1, 0.05, 4, 0.05);
+    const int n = 6000;
+    double sum = 0;
+    for(int k = 0; k < n; ++k) {
+        Vec3<double> w = bias + Vec3<double>{gyro_noise(generator),gyro_noise(generator),gyro_noise(generator)};
+        Vec3<double> a = s.a + Vec3<double>{obs_noise(generator),obs_noise(generator),obs_noise(generator)};
+        Vec3<double> m = s.m + Vec3<double>{obs_noise(generator),obs_noise(generator),obs_noise(generator)};
+        M.update_filter(w, dt, a, m);
+        if(k >= n - n/4) {
+            double e = angle_between(M.get_attitude(), s.q);
+            sum += e*e;
+        }
+    }
+    return sqrt(sum/(n/4));
+}
+
+int main()
+{
+    const Vec3<double> w{0.01,-0.02,0.005};
+    //Slightly tilted, so that the correction is not zero
+    const Vec3<double> a{0.05,-0.03,1}, m{0.62,0.02,-0.78};
+    //Contradictory observations, skipped at rest
+    const Vec3<double> a_bad{1,0,0}, m_bad{0,1,0};
+
+    ECF<double,2> E, E_fresh;
+    for(auto* F : {&E, &E_fresh}) {
+        F->set_gains(1.0, 0.3, 1.0, 1.0);
+        F->set_reference_vectors(up, field);
+        F->set_schedule(0.1, 10, 4, 1);
+    }
+    E.update_filter(w, dt, a, m);
+    for(int k = 0; k < 3; ++k)
+        E.update_filter(w, dt, a_bad, m_bad);
+    E.reset_filter();
+    E.update_filter(w, dt, a, m);
+    E_fresh.update_filter(w, dt, a, m);
+    check_same("ECF", E, E_fresh);
+
+    Madgwick<double> M, M_fresh;
+    for(auto* F : {&M, &M_fresh}) {
+        F->set_gains(2.0, 1.0, 0.2);
+        F->set_schedule(0.1, 10, 4, 1);
+    }
+    M.update_filter(w, dt, a, m);
+    for(int k = 0; k < 3; ++k)
+        M.update_filter(w, dt, a_bad, m_bad);
+    M.reset_filter();
+    M.update_filter(w, dt, a, m);
+    M_fresh.update_filter(w, dt, a, m);
+    check_same("Madgwick", M, M_fresh);
+
+    //Madgwick only moves while the gyro reads a rate, here an uncorrected bias
+    const Vec3<double> w_bias{0.03,-0.02,0.01};
+    const Scene near{0.02}, far{0.1};
+    //One correction, max_skip skipped, then the resumed one
+    check("Madgwick skips up to max_skip", abs(madgwick_skips(near, w_bias, 0.05, 4, 1, 6) - 4.0), 0);
+    //max_interval 0.035 s allows two skipped samples of 0.01 s after each correction
+    check("Madgwick skips within max_interval", abs(madgwick_skips(near, w_bias, 0.05, 10, 0.035, 9) - 6.0), 0);
+    check("Madgwick corrects while moving", madgwick_skips(near, Vec3<double>{0.3,0,0}, 0.05, 4, 1, 10), 0);
+
+    //0.05 rad separates an error of 0.02 rad from one of 0.1 rad in both filters
+    check("Madgwick corrects a large error", madgwick_skips(far, w_bias, 0.05, 4, 1, 10), 0);
+    check("ECF corrects a large error", ecf_skips(far, 0.05, 10), 0);
+    check("ECF skips a small error", abs(ecf_skips(near, 0.05, 6) - 4.0), 0);
+
+    //Far from the minimum the resumed correction covers what five consecutive ones do
+    for(double angle : {0.1, 0.003}) {
+        Scene s{angle};
+        Madgwick<double> P, A;
+        P.set_gains(2.0, 1.0, 0.2);
+        A.set_gains(2.0, 1.0, 0.2);
+        A.set_schedule(0.1, 1, 4, 1);
+        double before = 0;
+        for(int k = 0; k < 6; ++k) {
+            if(k == 5)
+                before = angle_between(A.get_attitude(), s.q);
+            P.update_filter(w_bias, dt, s.a, s.m);
+            A.update_filter(w_bias, dt, s.a, s.m);
+        }
+        double after = angle_between(A.get_attitude(), s.q);
+        double moved = angle - angle_between(P.get_attitude(), s.q);
+        if(angle > 0.01)
+            check("Madgwick resumed vs consecutive", angle_between(A.get_attitude(), P.get_attitude()), 0.15*moved);
+        else
+            //Five steps span twice the error, the resumed one stops near the minimum
+            check("Madgwick resumed steps past the minimum", after, 0.6*before);
+    }
+    check("Madgwick accuracy at rest, scheduled over plain", madgwick_rms_at_rest(true)/madgwick_rms_at_rest(false), 1.2);
+
+    return failures ? 1 : 0;
+}